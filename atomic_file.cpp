@@ -0,0 +1,96 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "atomic_file.h"
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+FileLock::FileLock(const char *path)
+{
+	std::string lockFile = std::string(path) + ".lock";
+	fd = open(lockFile.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0 || flock(fd, LOCK_EX) < 0) {
+		fprintf(stderr, "Cannot lock %s (%s)\n", lockFile.c_str(), strerror(errno));
+		if (fd >= 0) close(fd);
+		fd = -1;
+	}
+}
+
+FileLock::~FileLock()
+{
+	if (fd < 0) return;
+	flock(fd, LOCK_UN);
+	close(fd);
+}
+
+AtomicFile::AtomicFile(const char *path, bool durable) : 
+	path(path), tmpPath(std::string(path) + ".XXXXXX"), durable(durable), f(NULL)
+{
+	int fd = mkstemp(&tmpPath[0]);
+	if (fd >= 0) {
+		// mkstemp file is private, file is read by other users
+		fchmod(fd, 0644);
+		f = fdopen(fd, "wb");
+		if (!f) close(fd);
+	}
+	if (!f) {
+		fprintf(stderr, "Cannot create %s (%s)\n", tmpPath.c_str(), strerror(errno));
+		if (fd >= 0) unlink(tmpPath.c_str());
+	}
+}
+
+AtomicFile::~AtomicFile()
+{
+	if (!f) return;
+	fclose(f);
+	unlink(tmpPath.c_str());
+}
+
+int AtomicFile::Commit()
+{
+	if (!f) return -1;
+	bool ok = fflush(f) == 0 && !ferror(f);
+	if (durable) ok = ok && fsync(fileno(f)) == 0;
+	ok = fclose(f) == 0 && ok;
+	f = NULL;
+	if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+		fprintf(stderr, "Cannot write %s (%s)\n", path.c_str(), strerror(errno));
+		unlink(tmpPath.c_str());
+		return -1;
+	}
+	if (durable) SyncDirectory(path.c_str());
+	return 0;
+}
+
+void SyncDirectory(const char *path)
+{
+	std::string dir = path;
+	int fd = open(dirname(&dir[0]), O_RDONLY);
+	if (fd >= 0) {
+		fsync(fd);
+		close(fd);
+	}
+}
@@ -0,0 +1,65 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ATOMIC_FILE_H
+#define ATOMIC_FILE_H
+
+#include <stdio.h>
+#include <string>
+
+// Exclusive lock of <path>.lock shared by processes, held while object
+// exists. Lock file is left in place, so all processes lock same inode.
+class FileLock
+{
+public:
+	FileLock(const char *path);
+	~FileLock();
+	bool IsLocked() const { return fd >= 0; }
+private:
+	FileLock(const FileLock&);
+	FileLock& operator=(const FileLock&);
+	int fd;
+};
+
+// File written to temporary file in same directory and renamed over path
+// by Commit, so readers see either old or complete new file. Commit makes
+// data and rename durable. Temporary file is removed if not committed.
+class AtomicFile
+{
+public:
+	AtomicFile(const char *path, bool durable = true);
+	~AtomicFile();
+	// Stream of temporary file, NULL if it could not be created
+	FILE *File() const { return f; }
+	// Returns -1 on write or rename error
+	int Commit();
+private:
+	AtomicFile(const AtomicFile&);
+	AtomicFile& operator=(const AtomicFile&);
+	std::string path;
+	std::string tmpPath;
+	bool durable;
+	FILE *f;
+};
+
+// Makes rename or creation of file in directory of path durable
+void SyncDirectory(const char *path);
+
+#endif
@@ -0,0 +1,363 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Throughput benchmark of settings parsing (with and without cache), binary
+// loading, Encode, Decode, integrity trailer check, pin validation, golden
+// image compare, image store, Write, Print and Dump on synthetic settings
+// files. Results are printed to stdout as one JSON object per line:
+// {"bench":"parse","variant":"pins74","batch":1000,"seconds":...,"images_per_sec":...}
+// Concurrent build, encode and print on 1 to number of cores threads has
+// threads field. Correctness of it is checked by make check.
+// Programming of simulated EEPROMs (5 ms page write, 100 kHz bus) reports
+// boards per hour of whole image and diff-only writes on one target and on
+// parallel targets:
+// {"bench":"program_whole","targets":4,"boards":16,"seconds":...,"boards_per_hour":...}
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "cape_eeprom.h"
+#include "cape_eeprom_layout.h"
+#include "settings_cache.h"
+#include "pin_validator.h"
+#include "image_diff.h"
+#include "image_store.h"
+#include "worker_pool.h"
+#include "cape_crc.h"
+#include "eeprom_programmer.h"
+
+struct BenchVariant {
+	const char *name;
+	int pins;
+	int commentLines;	// comment lines before each setting
+	std::string settingsFile;
+	std::string imageFile;
+};
+
+static FILE *out;
+static std::string tmpDir;
+
+static void Report(const char *bench, const BenchVariant &v, size_t batch, double seconds, unsigned int threads = 0)
+{
+	fprintf(out, "{\"bench\":\"%s\",\"variant\":\"%s\",\"batch\":%zu,", bench, v.name, batch);
+	if (threads) fprintf(out, "\"threads\":%u,", threads);
+	fprintf(out, "\"seconds\":%.6f,\"images_per_sec\":%.1f}\n", seconds, seconds > 0 ? batch / seconds : 0.0);
+	fflush(out);
+}
+
+template <typename F>
+static double Time(size_t batch, F f)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < batch; i++) f(i);
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void WriteComments(FILE *f, int n)
+{
+	for (int i = 0; i < n; i++) 
+		fprintf(f, "# Synthetic comment line %d of benchmark settings file, describes setting below.\n", i);
+}
+
+// Generates settings file with pins pinconfig lines
+static void MakeSettings(BenchVariant &v)
+{
+	v.settingsFile = tmpDir + "/" + v.name + ".txt";
+	v.imageFile = tmpDir + "/" + v.name + ".eep";
+	
+	FILE *f = fopen(v.settingsFile.c_str(), "w");
+	if (!f) {
+		perror(v.settingsFile.c_str());
+		exit(1);
+	}
+	static const char * const settings[] = {
+		"board_name \"Benchmark cape\"",
+		"version \"00A0\"",
+		"manufacturer \"CapeEverything\"",
+		"part_number \"bb-cape-bench\"",
+		"assembly_code \"0003\"",
+		"week_of_production 38",
+		"year_of_production 17",
+		"board_number 1",
+		"vdd_3V3b_current 30",
+		"vdd_5v_current 0",
+		"sys_5v_current 100",
+		"dc_supplied 0"
+	};
+	for (size_t i = 0; i < sizeof(settings)/sizeof(settings[0]); i++) {
+		WriteComments(f, v.commentLines);
+		fprintf(f, "%s\n", settings[i]);
+	}
+	WriteComments(f, v.commentLines);
+	fprintf(f, "number_of_pins %d\n", v.pins);
+	for (int i = 0; i < v.pins; i++) {
+		WriteComments(f, v.commentLines);
+		fprintf(f, "pinconfig\tP%d_%d\t%d\t%s\t%s\t%s\t%s\n", bb_pins[i][0], bb_pins[i][1], i % 8, 
+			i % 2 ? "SLOW" : "FAST", i % 3 ? "OUTPUT" : "INPUT", i % 5 ? "PULL_DOWN" : "PULL_UP",
+			i % 7 ? "RX_DISABLE" : "RX_ENABLE");
+	}
+	fclose(f);
+	
+	CapeEeprom(v.settingsFile).Write(v.imageFile.c_str());
+}
+
+static void RunBenchmarks(BenchVariant &v, size_t batch)
+{
+	std::string outFile = tmpDir + "/out.eep";
+	CapeEeprom cape(v.settingsFile);
+	
+	Report("parse", v, batch, Time(batch, [&](size_t) { 
+		CapeEeprom c(v.settingsFile); 
+	}));
+	// Warm cache, every iteration is a hit
+	SettingsCache cache((tmpDir + "/cache").c_str(), "bench");
+	CapeLoadOptions options;
+	options.cache = &cache;
+	CapeEeprom warm(v.settingsFile, options);
+	Report("parse_cached", v, batch, Time(batch, [&](size_t) { 
+		CapeEeprom c(v.settingsFile, options); 
+	}));
+	// Hit of new process, entry is read from file
+	Report("parse_cache_file", v, batch, Time(batch, [&](size_t) { 
+		SettingsCache fresh((tmpDir + "/cache").c_str(), "bench");
+		CapeLoadOptions o;
+		o.cache = &fresh;
+		CapeEeprom c(v.settingsFile, o); 
+	}));
+	Report("load", v, batch, Time(batch, [&](size_t) { 
+		CapeEeprom c(v.imageFile); 
+	}));
+	uint8_t image[CAPE_EEPROM_SIZE];
+	Report("encode", v, batch, Time(batch, [&](size_t i) { 
+		cape.SetBoardNumber(i % 10000);
+		cape.Encode(image, sizeof(image)); 
+	}));
+	char fname[CAPE_FILE_NAME_MAX];
+	Report("hot_path", v, batch, Time(batch, [&](size_t i) { 
+		cape.SetBoardNumber(i % 10000);
+		cape.Encode(image, sizeof(image)); 
+		cape.FileName(fname, sizeof(fname), true);
+	}));
+	Report("decode", v, batch, Time(batch, [&](size_t) { 
+		CapeEeprom c;
+		c.Decode(image, sizeof(image)); 
+	}));
+	uint8_t sealed[CAPE_SEALED_SIZE];
+	cape.EncodeSealed(sealed, sizeof(sealed));
+	Report("crc_verify", v, batch, Time(batch, [&](size_t) { 
+		if (CheckCapeImageSeal(sealed, sizeof(sealed)) != CAPE_SEAL_OK) exit(1); 
+	}));
+	Report("validate", v, batch, Time(batch, [&](size_t) { 
+		ValidateCapeImage(image); 
+	}));
+	ImageDiff diff(image, IMAGE_DIFF_IGNORE_SERIAL);
+	Report("diff_equal", v, batch, Time(batch, [&](size_t) { 
+		if (!diff.Equal(image)) exit(1); 
+	}));
+	Report("write", v, batch, Time(batch, [&](size_t i) { 
+		cape.SetBoardNumber(i % 10000);
+		cape.Write(outFile.c_str()); 
+	}));
+	Report("print", v, batch, Time(batch, [&](size_t) { 
+		cape.Print(); 
+	}));
+	Report("print_json", v, batch, Time(batch, [&](size_t) { 
+		cape.Print(CAPE_PRINT_JSON); 
+	}));
+	Report("print_csv", v, batch, Time(batch, [&](size_t) { 
+		cape.Print(CAPE_PRINT_CSV); 
+	}));
+	// Bulk formatting of batch images into one buffer
+	Report("bulk_print_json", v, batch, Time(1, [&](size_t) { 
+		CapeFormatter formatter(stdout);
+		for (size_t i = 0; i < batch; i++) formatter.Print(CapeEepromView(image), CAPE_PRINT_JSON, i);
+	}));
+	Report("bulk_dump", v, batch, Time(1, [&](size_t) { 
+		CapeFormatter formatter(stdout);
+		for (size_t i = 0; i < batch; i++) formatter.Dump(image, sizeof(image));
+	}));
+	// Store of batch boards built in one append, then each board extracted
+	std::string storeFile = tmpDir + "/store.ces";
+	std::vector<uint8_t> images(batch * CAPE_EEPROM_SIZE);
+	std::vector<const uint8_t*> imagePtrs(batch);
+	for (size_t i = 0; i < batch; i++) {
+		cape.SetBoardNumber(i % 10000);
+		cape.Encode(&images[i * CAPE_EEPROM_SIZE], CAPE_EEPROM_SIZE);
+		imagePtrs[i] = &images[i * CAPE_EEPROM_SIZE];
+	}
+	Report("store_append", v, batch, Time(1, [&](size_t) { 
+		CapeImageStore::Append(storeFile.c_str(), imagePtrs.data(), batch); 
+	}));
+	{
+		CapeImageStore store(storeFile.c_str());
+		Report("store_extract", v, batch, Time(batch, [&](size_t i) { 
+			long k = store.Find(CapeEepromView(imagePtrs[i]).GetSerialNumber());
+			if (k >= 0) store.Extract(k, image);
+		}));
+	}
+	unlink(storeFile.c_str());
+	unlink((storeFile + IMAGE_STORE_LOG_SUFFIX).c_str());
+	// One append per board, as stations add shipped boards
+	Report("store_append_each", v, batch, Time(batch, [&](size_t i) { 
+		CapeImageStore::Append(storeFile.c_str(), &imagePtrs[i], 1); 
+	}));
+	unlink(storeFile.c_str());
+	unlink((storeFile + IMAGE_STORE_LOG_SUFFIX).c_str());
+	unlink((storeFile + ".lock").c_str());
+	Report("dump", v, batch, Time(batch, [&](size_t) { 
+		cape.Dump(); 
+	}));
+	fflush(stdout);
+}
+
+// Builds batch images concurrently, each parsed from settings file, given
+// its own board number, encoded, decoded and printed
+static void RunThreadBenchmarks(BenchVariant &v, size_t batch)
+{
+	unsigned int cores = std::thread::hardware_concurrency();
+	for (unsigned int threads = 1; ; threads *= 2) {
+		if (threads > cores) threads = cores ? cores : 1;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		RunParallel(batch, threads, [&](size_t i) {
+			CapeEeprom cape(v.settingsFile);
+			cape.SetBoardNumber(i % 10000);
+			uint8_t image[CAPE_EEPROM_SIZE];
+			cape.Encode(image, sizeof(image));
+			CapeEeprom decoded;
+			decoded.Decode(image, sizeof(image));
+			cape.Print();
+		});
+		Report("mt_build", v, batch, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), threads);
+		if (threads >= cores) break;
+	}
+}
+
+#define PROGRAM_BENCH_BOARDS	16
+#define PROGRAM_BENCH_TARGETS	4
+
+// Programs boards on targets simulated EEPROMs, each target programs its
+// share of boards one after another. Whole image writes program each board
+// on erased EEPROM, diff-only writes reprogram EEPROM holding image of 
+// previous board, which differs only in serial number.
+static void RunProgramBenchmark(const CapeEeprom &cape, bool whole, unsigned int targets)
+{
+	const unsigned int boards = PROGRAM_BENCH_BOARDS;
+	std::atomic<int> failed(0);
+	
+	auto program = [&](unsigned int board, const char *device) {
+		CapeEeprom c(cape);
+		c.SetBoardNumber(board);
+		uint8_t image[CAPE_EEPROM_SIZE];
+		c.Encode(image, sizeof(image));
+		ProgramResult r;
+		if (ProgramEeprom(device, image, sizeof(image), EEPROM_PAGE_SIZE, &r) < 0) failed++;
+	};
+	if (!whole) {
+		for (unsigned int t = 0; t < targets; t++) {
+			char device[64];
+			snprintf(device, sizeof(device), "sim:@diff%u_%u", targets, t);
+			program(0, device);
+		}
+	}
+	
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	RunParallel(targets, targets, [&](size_t t) {
+		char device[64];
+		for (unsigned int b = t; b < boards; b += targets) {
+			if (whole) snprintf(device, sizeof(device), "sim:@whole%u_%u", targets, b);
+			else snprintf(device, sizeof(device), "sim:@diff%u_%zu", targets, t);
+			program(b + 1, device);
+		}
+	});
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	
+	fprintf(out, "{\"bench\":\"%s\",\"targets\":%u,\"boards\":%u,\"seconds\":%.6f,\"boards_per_hour\":%.1f}\n", 
+		whole ? "program_whole" : "program_diff", targets, boards, seconds, seconds > 0 ? boards * 3600 / seconds : 0.0);
+	fflush(out);
+	if (failed) {
+		fprintf(stderr, "eepcape_bench: %d simulated boards failed\n", failed.load());
+		exit(1);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<size_t> batches;
+	for (int i = 1; i < argc; i++) batches.push_back(strtoul(argv[i], NULL, 10));
+	if (batches.empty()) batches = {1, 100, 1000};
+	
+	// Results go to original stdout, output of Print and Dump is discarded
+	fflush(stdout);
+	out = fdopen(dup(STDOUT_FILENO), "w");
+	int nullFd = open("/dev/null", O_WRONLY);
+	if (!out || nullFd < 0 || dup2(nullFd, STDOUT_FILENO) < 0) {
+		perror("eepcape_bench");
+		return 1;
+	}
+	close(nullFd);
+	
+	char dirTemplate[] = "/tmp/eepcape_bench.XXXXXX";
+	if (!mkdtemp(dirTemplate)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	tmpDir = dirTemplate;
+	
+	BenchVariant variants[] = {
+		{"pins0", 0, 0, "", ""},
+		{"pins8", 8, 0, "", ""},
+		{"pins32", 32, 0, "", ""},
+		{"pins74", 74, 0, "", ""},
+		{"pins74_comments", 74, 20, "", ""}
+	};
+	
+	for (BenchVariant &v : variants) {
+		MakeSettings(v);
+		if (&v == &variants[0]) {
+			CapeEeprom cape(v.settingsFile);
+			for (bool whole : {true, false}) 
+				for (unsigned int targets : {1, PROGRAM_BENCH_TARGETS}) RunProgramBenchmark(cape, whole, targets);
+		}
+		for (size_t batch : batches) RunBenchmarks(v, batch);
+		RunThreadBenchmarks(v, batches.back());
+		unlink(v.settingsFile.c_str());
+		unlink(v.imageFile.c_str());
+	}
+	
+	unlink((tmpDir + "/out.eep").c_str());
+	std::string cacheDir = tmpDir + "/cache";
+	if (DIR *d = opendir(cacheDir.c_str())) {
+		while (struct dirent *e = readdir(d)) 
+			if (e->d_name[0] != '.') unlink((cacheDir + "/" + e->d_name).c_str());
+		closedir(d);
+		rmdir(cacheDir.c_str());
+	}
+	rmdir(tmpDir.c_str());
+	return 0;
+}
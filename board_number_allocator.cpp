@@ -0,0 +1,169 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "board_number_allocator.h"
+#include "atomic_file.h"
+#include <stdio.h>
+#include <string.h>
+
+#define FIRST_BOARD_NUMBER	1
+
+// Moves next free board number of state past new reserved range
+static int ReserveRange(int &next, int &rangeNext, int &rangeEnd, unsigned int reserve)
+{
+	if (next > BOARD_NUMBER_MAX) return -1;
+	rangeNext = next;
+	rangeEnd = next + reserve > BOARD_NUMBER_MAX + 1 ? BOARD_NUMBER_MAX + 1 : next + reserve;
+	next = rangeEnd;
+	return 0;
+}
+
+// Moves next free board number of state past exactly reserve board numbers
+static int ReserveExactRange(int &next, int &rangeNext, int &rangeEnd, unsigned int reserve)
+{
+	if (next + reserve > BOARD_NUMBER_MAX + 1) return -1;
+	rangeNext = next;
+	rangeEnd = next + reserve;
+	next = rangeEnd;
+	return 0;
+}
+
+// Returns unused rest of range if nothing was reserved after it
+static int ReleaseRange(int &next, int &rangeNext, int &rangeEnd, unsigned int)
+{
+	if (next == rangeEnd) next = rangeNext;
+	rangeNext = rangeEnd;
+	return 0;
+}
+
+BoardNumberAllocator::BoardNumberAllocator(const char *stateFile, unsigned int reserve) :
+	stateFile(stateFile), reserve(reserve ? reserve : 1)
+{
+}
+
+BoardNumberAllocator::~BoardNumberAllocator()
+{
+	for (size_t i = 0; i < ranges.size(); i++) {
+		if (ranges[i].next < ranges[i].end) _UpdateState(ranges[i], ReleaseRange);
+	}
+}
+
+int BoardNumberAllocator::Allocate(const char *asmCode, int week, int year)
+{
+	std::lock_guard<std::mutex> guard(mutex);
+	Range *range = NULL;
+	
+	for (size_t i = 0; i < ranges.size() && !range; i++) {
+		if (ranges[i].asmCode == asmCode && ranges[i].week == week && ranges[i].year == year) 
+			range = &ranges[i];
+	}
+	if (!range) {
+		Range r = {asmCode, week, year, 0, 0, 0};
+		ranges.push_back(r);
+		range = &ranges.back();
+	}
+	
+	if (range->next >= range->end) {
+		range->block = range->block ? range->block * 2 : 1;
+		if (range->block > reserve) range->block = reserve;
+		if (_UpdateState(*range, ReserveRange) < 0) return -1;
+	}
+	return range->next++;
+}
+
+int BoardNumberAllocator::AllocateRange(const char *asmCode, int week, int year, unsigned int count)
+{
+	if (count <= 1) return Allocate(asmCode, week, year);
+	
+	// Range is taken from state directly, it is never released
+	std::lock_guard<std::mutex> guard(mutex);
+	Range r = {asmCode, week, year, 0, 0, count};
+	if (_UpdateState(r, ReserveExactRange) < 0) return -1;
+	return r.next;
+}
+
+// State file lines: "assembly code" week year next_board_number
+struct StateEntry {
+	char asmCode[5];
+	int week;
+	int year;
+	int next;
+};
+
+// Parses state file line, returns false for comment or damaged line.
+// Assembly code may be empty, so it is not parsed by sscanf.
+static bool ParseStateLine(const char *line, StateEntry &e)
+{
+	const char *p = line + strspn(line, " \t");
+	if (*p++ != '"') return false;
+	const char *end = strchr(p, '"');
+	if (!end || end - p >= (int)sizeof(e.asmCode)) return false;
+	memcpy(e.asmCode, p, end - p);
+	e.asmCode[end - p] = '\0';
+	return sscanf(end + 1, "%d %d %d", &e.week, &e.year, &e.next) == 3;
+}
+
+int BoardNumberAllocator::_UpdateState(Range &range, StateUpdate update)
+{
+	FileLock lock(stateFile.c_str());
+	if (!lock.IsLocked()) return -1;
+	
+	std::vector<StateEntry> entries;
+	StateEntry *entry = NULL;
+	
+	FILE *f = fopen(stateFile.c_str(), "r");
+	if (f) {
+		char line[100];
+		while (fgets(line, sizeof(line), f)) {
+			StateEntry e;
+			if (ParseStateLine(line, e)) entries.push_back(e);
+		}
+		fclose(f);
+	}
+	for (size_t i = 0; i < entries.size() && !entry; i++) {
+		if (range.asmCode == entries[i].asmCode && range.week == entries[i].week && range.year == entries[i].year) 
+			entry = &entries[i];
+	}
+	if (!entry) {
+		StateEntry e = {"", range.week, range.year, FIRST_BOARD_NUMBER};
+		snprintf(e.asmCode, sizeof(e.asmCode), "%s", range.asmCode.c_str());
+		entries.push_back(e);
+		entry = &entries.back();
+	}
+	
+	int ret = update(entry->next, range.next, range.end, range.block);
+	if (ret < 0) {
+		fprintf(stderr, "No free board numbers left for assembly code %s, week %d, year %d\n", 
+			range.asmCode.c_str(), range.week, range.year);
+	} else {
+		// Write new state to temporary file and rename it over state file
+		AtomicFile state(stateFile.c_str());
+		if (state.File()) {
+			fprintf(state.File(), "# \"assembly code\" week year next_board_number\n");
+			for (size_t i = 0; i < entries.size(); i++) 
+				fprintf(state.File(), "\"%s\" %d %d %d\n", entries[i].asmCode, entries[i].week, entries[i].year, entries[i].next);
+		}
+		if (state.Commit() < 0) {
+			range.next = range.end;
+			ret = -1;
+		}
+	}
+	return ret;
+}
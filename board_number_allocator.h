@@ -0,0 +1,67 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BOARD_NUMBER_ALLOCATOR_H
+#define BOARD_NUMBER_ALLOCATOR_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+
+#define BOARD_NUMBER_MAX		9999
+#define BOARD_NUMBER_RESERVE	16
+
+// Allocates unique board numbers for assembly code, week and year of
+// production, shared by all processes using same state file. Next free
+// board number of each key is kept in state file, which is updated under
+// exclusive lock of <state file>.lock and replaced atomically, so it stays
+// consistent if process crashes. Each process reserves range of board
+// numbers at once and hands them out from memory, range size doubles with
+// each reservation up to reserve. Unused rest of range is returned on
+// destruction if no other process reserved after it.
+class BoardNumberAllocator
+{
+public:
+	BoardNumberAllocator(const char *stateFile, unsigned int reserve = BOARD_NUMBER_RESERVE);
+	~BoardNumberAllocator();
+	// Returns unique board number, -1 if all board numbers are used or on error
+	int Allocate(const char *asmCode, int week, int year);
+	// Reserves count consecutive board numbers, returns first of them or -1
+	// if there is no such range left or on error
+	int AllocateRange(const char *asmCode, int week, int year, unsigned int count);
+private:
+	struct Range {
+		std::string asmCode;
+		int week;
+		int year;
+		int next;
+		int end;
+		unsigned int block;
+	};
+	typedef int (*StateUpdate)(int &next, int &rangeNext, int &rangeEnd, unsigned int reserve);
+	int _UpdateState(Range &range, StateUpdate update);
+	
+	std::string stateFile;
+	unsigned int reserve;	// maximum reserved range size
+	std::mutex mutex;
+	std::vector<Range> ranges;
+};
+
+#endif
@@ -0,0 +1,119 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cape_crc.h"
+#include "cape_eeprom_view.h"
+#include "worker_pool.h"
+#include <string.h>
+#include <array>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define CRC_HW_X86	1
+#endif
+
+#define CRC32C_POLY	0x82F63B78u
+
+// Slicing-by-8 tables, table[k][b] is CRC of byte b followed by k zero
+// bytes, built at compile time
+static constexpr std::array<std::array<uint32_t, 256>, 8> MakeCrcTables()
+{
+	std::array<std::array<uint32_t, 256>, 8> t = {};
+	for (uint32_t b = 0; b < 256; b++) {
+		uint32_t c = b;
+		for (int i = 0; i < 8; i++) c = (c >> 1) ^ (c & 1 ? CRC32C_POLY : 0);
+		t[0][b] = c;
+	}
+	for (int k = 1; k < 8; k++) 
+		for (uint32_t b = 0; b < 256; b++) t[k][b] = (t[k-1][b] >> 8) ^ t[0][t[k-1][b] & 0xff];
+	return t;
+}
+
+static constexpr std::array<std::array<uint32_t, 256>, 8> crc_tables = MakeCrcTables();
+
+static uint32_t Crc32cSoft(const uint8_t *p, size_t size, uint32_t crc)
+{
+	for (; size >= 8; p += 8, size -= 8) {
+		uint32_t lo = crc ^ (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24);
+		crc = crc_tables[7][lo & 0xff] ^ crc_tables[6][(lo >> 8) & 0xff] ^
+			crc_tables[5][(lo >> 16) & 0xff] ^ crc_tables[4][lo >> 24] ^
+			crc_tables[3][p[4]] ^ crc_tables[2][p[5]] ^ crc_tables[1][p[6]] ^ crc_tables[0][p[7]];
+	}
+	for (; size; p++, size--) crc = (crc >> 8) ^ crc_tables[0][(crc ^ *p) & 0xff];
+	return crc;
+}
+
+#ifdef CRC_HW_X86
+__attribute__((target("sse4.2")))
+static uint32_t Crc32cHw(const uint8_t *p, size_t size, uint32_t crc)
+{
+	uint64_t c = crc;
+	for (; size >= 8; p += 8, size -= 8) {
+		uint64_t w;
+		memcpy(&w, p, 8);
+		c = _mm_crc32_u64(c, w);
+	}
+	crc = c;
+	for (; size; p++, size--) crc = _mm_crc32_u8(crc, *p);
+	return crc;
+}
+
+static const bool crc_hw = __builtin_cpu_supports("sse4.2");
+#endif
+
+uint32_t Crc32c(const void *data, size_t size, uint32_t crc)
+{
+	crc = ~crc;
+#ifdef CRC_HW_X86
+	if (crc_hw) return ~Crc32cHw((const uint8_t*)data, size, crc);
+#endif
+	return ~Crc32cSoft((const uint8_t*)data, size, crc);
+}
+
+void SealCapeImage(uint8_t *image)
+{
+	uint32_t crc = Crc32c(image, CAPE_EEPROM_SIZE);
+	memcpy(image + CAPE_CRC_TAG_OFS, cape_crc_tag, CAPE_CRC_TAG_LEN);
+	image[CAPE_CRC_OFS] = crc >> 24;
+	image[CAPE_CRC_OFS + 1] = crc >> 16;
+	image[CAPE_CRC_OFS + 2] = crc >> 8;
+	image[CAPE_CRC_OFS + 3] = crc;
+}
+
+CapeSealStatus CheckCapeImageSeal(const uint8_t *image, size_t size)
+{
+	if (size < CAPE_SEALED_SIZE || memcmp(image + CAPE_CRC_TAG_OFS, cape_crc_tag, CAPE_CRC_TAG_LEN) != 0) 
+		return CAPE_SEAL_NONE;
+	const uint8_t *p = image + CAPE_CRC_OFS;
+	uint32_t crc = (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+	return Crc32c(image, CAPE_EEPROM_SIZE) == crc ? CAPE_SEAL_OK : CAPE_SEAL_BAD;
+}
+
+void VerifyCapeImages(const CapeImageMap &images, unsigned int jobs, std::vector<size_t> &failed)
+{
+	// Each chunk collects its own failures, merged in order
+	const size_t chunk = 16384;
+	size_t n = images.Count();
+	std::vector<std::vector<size_t> > found((n + chunk - 1) / chunk);
+	RunParallel(found.size(), jobs, [&](size_t c) {
+		for (size_t i = c * chunk; i < n && i < (c + 1) * chunk; i++) 
+			if (CheckCapeImageSeal(images[i].Data(), images.Stride()) != CAPE_SEAL_OK) found[c].push_back(i);
+	});
+	for (const std::vector<size_t> &f : found) failed.insert(failed.end(), f.begin(), f.end());
+}
@@ -0,0 +1,50 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CAPE_CRC_H
+#define CAPE_CRC_H
+
+#include <stddef.h>
+#include <vector>
+#include "cape_eeprom_layout.h"
+
+class CapeImageMap;
+
+enum CapeSealStatus {
+	CAPE_SEAL_NONE,		// image has no integrity trailer
+	CAPE_SEAL_OK,
+	CAPE_SEAL_BAD		// trailer CRC does not match image
+};
+
+// CRC32C (Castagnoli) of data continuing from crc, with SSE4.2 crc32
+// instruction when CPU has it, otherwise slicing-by-8 tables
+uint32_t Crc32c(const void *data, size_t size, uint32_t crc = 0);
+
+// Writes integrity trailer past 244 byte image, image buffer must hold
+// CAPE_SEALED_SIZE bytes
+void SealCapeImage(uint8_t *image);
+// Checks integrity trailer of image of size bytes
+CapeSealStatus CheckCapeImageSeal(const uint8_t *image, size_t size);
+
+// Checks trailers of all images of archive in parallel chunks on jobs
+// threads. Appends indexes of images with bad or missing trailer to failed.
+void VerifyCapeImages(const CapeImageMap &images, unsigned int jobs, std::vector<size_t> &failed);
+
+#endif
@@ -19,6 +19,14 @@ along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "cape_eeprom.h"
+#include "cape_eeprom_layout.h"
+#include "eeprom_programmer.h"
+#include "board_number_allocator.h"
+#include "settings_parser.h"
+#include "settings_cache.h"
+#include "pin_validator.h"
+#include "cape_stats.h"
+#include "cape_crc.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -26,55 +34,187 @@ along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
 #include <time.h>
 #include <fstream>
 #include <sstream>
+#include <charconv>
+#include <algorithm>
 
-#if defined(_WIN32)
- 
-typedef __int8              int8_t;
-typedef __int16             int16_t;
-typedef __int32             int32_t;
-typedef __int64             int64_t;
-typedef unsigned __int8     uint8_t;
-typedef unsigned __int16    uint16_t;
-typedef unsigned __int32    uint32_t;
-typedef unsigned __int64    uint64_t;
- 
-#endif
+// Settings file keywords
+enum {
+	KW_BOARD_NAME,
+	KW_VERSION,
+	KW_MANUFACTURER,
+	KW_PART_NUMBER,
+	KW_NUMBER_OF_PINS,
+	KW_ASSEMBLY_CODE,
+	KW_WEEK_OF_PRODUCTION,
+	KW_YEAR_OF_PRODUCTION,
+	KW_BOARD_NUMBER,
+	KW_VDD_3V3B_CURRENT,
+	KW_VDD_5V_CURRENT,
+	KW_SYS_5V_CURRENT,
+	KW_DC_SUPPLIED,
+	KW_PINCONFIG,
+	KW_VARIANT,
+	KW_UNKNOWN = -1
+};
 
-#define PIN_UNUSED			(0x0000 << 15)
-#define PIN_USED			(0x0001 << 15)
-#define PINDIR_INPUT		(0x0001 << 13)
-#define PINDIR_OUTPUT		(0x0002 << 13)
-#define PINDIR_BDIR			(0x0003 << 13)
-#define PINSLEW_SLOW		(0x0001 << 6)
-#define PINSLEW_FAST		(0x0000 << 6)
-#define PINRX_DISABLE		(0x0000 << 5)
-#define PINRX_ENABLE		(0x0001 << 5)
-#define PINPULL_DOWN		(0x0000 << 4)
-#define PINPULL_UP			(0x0001 << 4)
-#define PINPULL_DISABLE		(0x0001 << 3)
-#define PINPULL_ENABLE		(0x0000 << 3)
-
-static const uint8_t bb_pins[][2] = {
-	{9,22}, {9,21}, {9,18}, {9,17}, {9,42}, {8,35}, {8,33}, {8,31}, {8,32}, {9,19},
-	{9,20}, {9,26}, {9,24}, {9,41}, {8,19}, {8,13}, {8,14}, {8,17}, {9,11}, {9,13},
-	{8,25}, {8,24}, {8,5}, {8,6}, {8,23}, {8,22}, {8,3}, {8,4},{8,12},{8,11},
-	{8,16},{8,15},{9,15},{9,23},{9,14},{9,16},{9,12},{8,26},{8,21},{8,20},
-	{8,18},{8,7},{8,9},{8,10},{8,8},{8,45},{8,46},{8,43},{8,44},{8,41},
-	{8,42},{8,39},{8,40},{8,37},{8,38},{8,36},{8,34},{8,27},{8,29},{8,28},
-	{8,30},{9,29},{9,30},{9,28},{9,27},{9,31},{9,25},{9,39},{9,40},{9,37},
-	{9,38},{9,33},{9,36},{9,35}
+// Pinconfig option token classes
+enum {
+	OPT_SLEW,
+	OPT_DIRECTION,
+	OPT_PULL,
+	OPT_RX
 };
 
-static int8_t pin_order[128];
-			
-template <typename T>
-std::string NumberToString ( T Number )
+struct Token {
+	std::string_view name;
+	int id;
+	uint16_t value;
+};
+
+static constexpr Token keywords[] = {
+	{"board_name",			KW_BOARD_NAME,			0},
+	{"version",				KW_VERSION,				0},
+	{"manufacturer",		KW_MANUFACTURER,		0},
+	{"part_number",			KW_PART_NUMBER,			0},
+	{"number_of_pins",		KW_NUMBER_OF_PINS,		0},
+	{"assembly_code",		KW_ASSEMBLY_CODE,		0},
+	{"week_of_production",	KW_WEEK_OF_PRODUCTION,	0},
+	{"year_of_production",	KW_YEAR_OF_PRODUCTION,	0},
+	{"board_number",		KW_BOARD_NUMBER,		0},
+	{"vdd_3V3b_current",	KW_VDD_3V3B_CURRENT,	0},
+	{"vdd_5v_current",		KW_VDD_5V_CURRENT,		0},
+	{"sys_5v_current",		KW_SYS_5V_CURRENT,		0},
+	{"dc_supplied",			KW_DC_SUPPLIED,			0},
+	{"pinconfig",			KW_PINCONFIG,			0},
+	{"variant",				KW_VARIANT,				0}
+};
+
+static constexpr Token pin_options[] = {
+	{"SLOW",		OPT_SLEW,		PINSLEW_SLOW},
+	{"FAST",		OPT_SLEW,		PINSLEW_FAST},
+	{"INPUT",		OPT_DIRECTION,	PINDIR_INPUT},
+	{"OUTPUT",		OPT_DIRECTION,	PINDIR_OUTPUT},
+	{"BDIR",		OPT_DIRECTION,	PINDIR_BDIR},
+	{"PULL_DOWN",	OPT_PULL,		PINPULL_DOWN | PINPULL_ENABLE},
+	{"PULL_UP",		OPT_PULL,		PINPULL_UP | PINPULL_ENABLE},
+	{"PULL_NONE",	OPT_PULL,		PINPULL_DOWN | PINPULL_DISABLE},
+	{"RX_ENABLE",	OPT_RX,			PINRX_ENABLE},
+	{"RX_DISABLE",	OPT_RX,			PINRX_DISABLE}
+};
+
+static constexpr uint32_t TokenHash(std::string_view s, uint32_t seed)
+{
+	uint32_t h = seed;
+	for (size_t i = 0; i < s.size(); i++) h = (h ^ (uint8_t)s[i]) * 16777619u;
+	return h ^ (h >> 15);
+}
+
+// Perfect hash of token table, seed is searched at compile time so that
+// every token of the table maps to its own slot.
+template <size_t SLOTS>
+struct PerfectHash {
+	uint32_t seed;
+	int8_t slot[SLOTS];
+	
+	template <size_t N>
+	constexpr PerfectHash(const Token (&tokens)[N]) : seed(0), slot() {
+		static_assert((SLOTS & (SLOTS - 1)) == 0 && N <= SLOTS, "invalid perfect hash size");
+		for (uint32_t s = 2166136261u; seed == 0; s++) {
+			bool collision = false;
+			for (size_t i = 0; i < SLOTS; i++) slot[i] = -1;
+			for (size_t i = 0; i < N && !collision; i++) {
+				int8_t &e = slot[TokenHash(tokens[i].name, s) & (SLOTS - 1)];
+				collision = (e != -1);
+				e = i;
+			}
+			if (!collision) seed = s;
+		}
+	}
+	
+	// Returns table index of token equal to s, -1 if none
+	template <size_t N>
+	int Find(const Token (&tokens)[N], std::string_view s) const {
+		int i = slot[TokenHash(s, seed) & (SLOTS - 1)];
+		return (i >= 0 && tokens[i].name == s) ? i : -1;
+	}
+};
+
+static constexpr PerfectHash<32> keyword_hash(keywords);
+static constexpr PerfectHash<16> pin_option_hash(pin_options);
+
+static int FindKeyword(std::string_view s)
+{
+	int i = keyword_hash.Find(keywords, s);
+	return i < 0 ? KW_UNKNOWN : keywords[i].id;
+}
+
+#define SV(s)	(int)(s).size(), (s).data()
+
+// End of line position, for errors of missing values
+static const char *LineEnd(const SettingsLine &l)
+{
+	return l.text.data() + l.text.size();
+}
+
+// Checks that line has expected number of values
+static bool CheckArgCount(SettingsTokenizer &t, const SettingsLine &l, unsigned int n)
+{
+	if (l.argCount < n) {
+		t.Error(LineEnd(l), "missing value for %.*s", SV(l.keyword));
+		return false;
+	} else if (l.argCount > n) {
+		t.Error(l.args[n].data(), "unexpected value for %.*s", SV(l.keyword));
+		return false;
+	}
+	return true;
+}
+
+// Copies string value to fixed length field, padded with zeros
+static bool ParseString(SettingsTokenizer &t, const SettingsLine &l, char *param, size_t length)
+{
+	if (!CheckArgCount(t, l, 1)) return false;
+	std::string_view v = l.args[0];
+	if (v.size() > length) {
+		t.Error(v.data(), "%.*s longer than %zu characters, truncated", SV(l.keyword), length);
+		v = v.substr(0, length);
+	}
+	memset(param, 0, length);
+	memcpy(param, v.data(), v.size());
+	return true;
+}
+
+// Parses decimal number in range min to max
+static bool ParseNumber(SettingsTokenizer &t, const SettingsLine &l, std::string_view v, int min, int max, int &value)
+{
+	int n;
+	std::from_chars_result r = std::from_chars(v.data(), v.data() + v.size(), n);
+	if (r.ec != std::errc() || r.ptr != v.data() + v.size() || n < min || n > max) {
+		t.Error(v.data(), "%.*s value %.*s is not number from %d to %d", SV(l.keyword), SV(v), min, max);
+		return false;
+	}
+	value = n;
+	return true;
+}
+
+static bool ParseNumber(SettingsTokenizer &t, const SettingsLine &l, int min, int max, int &value)
+{
+	return CheckArgCount(t, l, 1) && ParseNumber(t, l, l.args[0], min, max, value);
+}
+
+// Parses pin name as P8_3 or P9_12, returns index of pin in bb_pins or -1
+static int ParsePin(std::string_view pin)
 {
-	char snum[20];
-	sprintf(snum, "%d", Number);
-	return std::string(snum);
+	int header, n;
+	if (pin.size() < 4 || (pin[0] != 'P' && pin[0] != 'p')) return -1;
+	const char *end = pin.data() + pin.size();
+	std::from_chars_result r = std::from_chars(pin.data() + 1, end, header);
+	if (r.ec != std::errc() || r.ptr == end || *r.ptr != '_') return -1;
+	r = std::from_chars(r.ptr + 1, end, n);
+	if (r.ec != std::errc() || r.ptr != end) return -1;
+	if (header < 8 || header > 9 || n < 0 || n >= 64) return -1;
+	return pin_order[(header-8)*64+n];
 }
-  
+			
 int GetWeek
 	(
 	struct tm* date
@@ -101,7 +241,7 @@ int GetWeek
 		// Unfortunately to do so we have to call mktime again to get the information we require.
 		// Here we can use a slight cheat - reuse this function!
 		// (This won't end up in a loop, because there's no way week will be zero again with these values).
-		tm lastDay = { 0 };
+		tm lastDay = {};
 		lastDay.tm_mday = 31;
 		lastDay.tm_mon = 11;
 		lastDay.tm_year = date->tm_year - 1;
@@ -141,78 +281,120 @@ int GetWeek
 	return week;
 }
 
-int CapeEeprom::Write(const char *fname)
+// Calls FIELD(member, offset) for each field of EEPROM image
+#define CAPE_IMAGE_FIELDS(FIELD) \
+	FIELD(magic,		CAPE_MAGIC_OFS) \
+	FIELD(rev,			CAPE_REV_OFS) \
+	FIELD(bname,		CAPE_BNAME_OFS) \
+	FIELD(version,		CAPE_VERSION_OFS) \
+	FIELD(manufacturer,	CAPE_MANUFACTURER_OFS) \
+	FIELD(part_number,	CAPE_PART_NUMBER_OFS) \
+	FIELD(n_pins,		CAPE_N_PINS_OFS) \
+	FIELD(serial,		CAPE_SERIAL_OFS) \
+	FIELD(pins,			CAPE_PINS_OFS) \
+	FIELD(vdd_3v3,		CAPE_VDD_3V3_OFS) \
+	FIELD(vdd_5v,		CAPE_VDD_5V_OFS) \
+	FIELD(sys_5v,		CAPE_SYS_5V_OFS) \
+	FIELD(dc,			CAPE_DC_OFS)
+
+#define CHECK_FIELD(m, ofs)		static_assert(offsetof(CapeEeprom, m) == ofs, "layout of " #m " differs from EEPROM image");
+#define ENCODE_FIELD(m, ofs)	memcpy(out + ofs, m, sizeof(m));
+#define DECODE_FIELD(m, ofs)	memcpy(m, in + ofs, sizeof(m));
+
+int CapeEeprom::Encode(uint8_t *out, size_t n) const
+{
+	CAPE_IMAGE_FIELDS(CHECK_FIELD)
+	static_assert(sizeof(CapeEeprom) == CAPE_EEPROM_SIZE, "size of CapeEeprom differs from EEPROM image");
+	
+	if (n < CAPE_EEPROM_SIZE) return -1;
+	CAPE_IMAGE_FIELDS(ENCODE_FIELD)
+	return CAPE_EEPROM_SIZE;
+}
+
+int CapeEeprom::EncodeSealed(uint8_t *out, size_t n) const
+{
+	if (n < CAPE_SEALED_SIZE) return -1;
+	Encode(out, n);
+	SealCapeImage(out);
+	return CAPE_SEALED_SIZE;
+}
+
+int CapeEeprom::Decode(const uint8_t *in, size_t n)
+{
+	if (n < CAPE_EEPROM_SIZE || memcmp(in + CAPE_MAGIC_OFS, cape_magic, CAPE_MAGIC_LEN) != 0) return -1;
+	if (CheckCapeImageSeal(in, n) == CAPE_SEAL_BAD) return -1;
+	CAPE_IMAGE_FIELDS(DECODE_FIELD)
+	return 0;
+}
+
+bool CapeEeprom::IsValid() const
+{
+	return memcmp(magic, cape_magic, CAPE_MAGIC_LEN) == 0;
+}
+
+int CapeEeprom::Write(const char *fname, CapeStats *stats, bool sealed)
 {
   FILE *f;
+  uint8_t image[CAPE_SEALED_SIZE];
+  size_t size;
+  CapeStatTimer timer (stats, STAT_WRITE);
 
   if ((f = fopen (fname, "wb")) == NULL)
     {
       fprintf (stderr, "Cannot open file: %s\n", fname);
       exit (1);
     }
-  fwrite (this, sizeof(CapeEeprom), 1, f);
+  size = sealed ? EncodeSealed (image, sizeof(image)) : Encode (image, sizeof(image));
+  fwrite (image, size, 1, f);
   fclose (f);
+  if (stats) stats->Count (STAT_BYTES_WRITTEN, size);
 
   return 0;
 }
 
-int CapeEeprom::Print()
+int CapeEeprom::Program(const char *device, int pageSize, ProgramResult *result, CapeStats *stats, bool sealed)
 {
-	printf ("#####################################################\n");
-	printf ("Cape Name         : %.32s\n", _GetAsciiParam(bname, 32).c_str());
-	printf ("Cape Version      : %s\n", GetVersion().c_str());
-	printf ("Cape Manufacturer : %.16s\n", _GetAsciiParam(manufacturer, 16).c_str());
-	printf ("Part Number       : %.16s\n", GetPartNumber().c_str());
-	printf ("Serial Number     : %.12s\n", _GetAsciiParam(serial, 12).c_str()); 
-	printf ("Pins Used         : %d\n", _ReadUint16BE(n_pins));
-	printf ("VDD_3V3B Current  : %d mA\n", _ReadUint16BE(vdd_3v3));
-	printf ("VDD_5V Current    : %d mA\n", _ReadUint16BE(vdd_5v));
-	printf ("SYS_5V Current    : %d mA\n", _ReadUint16BE(sys_5v));
-	printf ("Supplied Current  : %d mA\n", _ReadUint16BE(dc));
-	printf ("#####################################################\n");
-	printf ("Cape pins: \n");
-	//printf("%-7s%s  %-7s%-8s%-11s%s\n\n", "PIN", "MODE", "SLEW", "DIRECTION", "PULL", "RX" );
-	for (int i = 0; i < 74; i++) {
-		uint16_t pinconfig = _ReadUint16BE(&pins[i*2]);
-		if (pinconfig & PIN_USED) {
-			std::string pin = "P" + NumberToString(bb_pins[i][0]) +"_" + NumberToString(bb_pins[i][1]);
-			int mode = pinconfig & 0x07;
-			std::string slew = pinconfig & PINSLEW_SLOW ? "SLOW" : "FAST";
-			std::string dir;
-			switch (pinconfig & (0x0003<<13)) {
-				case PINDIR_BDIR: dir = "BDIR"; break;
-				case PINDIR_OUTPUT: dir = "OUTPUT"; break;
-				default: dir = "INPUT";
-			}
-			std::string pull = pinconfig & PINPULL_UP ? "PULL_UP" : "PULL_DOWN";
-			std::string rx = pinconfig & PINRX_ENABLE ? "RX_ENABLE" : "RX_DISABLE";
-		    printf("%-7s%d  %-7s%-8s%-11s%s\n", pin.c_str(), mode, slew.c_str(), dir.c_str(), pull.c_str(), rx.c_str());
-	  }
-  }
-  printf ("\n");
-  return 0;
+	uint8_t image[CAPE_SEALED_SIZE];
+	size_t size = sealed ? EncodeSealed(image, sizeof(image)) : Encode(image, sizeof(image));
+	
+	// Images violating pin rules are never programmed
+	std::vector<PinViolation> violations;
+	if (ValidateCapeImage(image, &violations)) {
+		*result = ProgramResult();
+		PrintPinViolations(stderr, violations, device);
+		return -1;
+	}
+	return ProgramEeprom(device, image, size, pageSize, result, stats);
+}
+
+int CapeEeprom::Print(CapePrintFormat format)
+{
+	uint8_t image[CAPE_EEPROM_SIZE];
+	Encode(image, sizeof(image));
+	
+	CapeFormatter formatter(stdout, 4096);
+	formatter.Header(format);
+	formatter.Print(CapeEepromView(image), format);
+	return 0;
 }
 
-std::string CapeEeprom::_GetAsciiParam(char *param, int lenth) {
-	static char temp[50];
-	strncpy(temp, param, lenth);
-	temp[lenth] = '\0';
-	return temp;
+std::string_view CapeEeprom::_GetAsciiParam(const char *param, int lenth) {
+	return std::string_view(param, strnlen(param, lenth));
 }
 
-std::string CapeEeprom::GetBoardName() {
+std::string_view CapeEeprom::GetBoardName() const {
 	return _GetAsciiParam(bname, 32);
 }
 
-std::string CapeEeprom::GetPartNumber() {
+std::string_view CapeEeprom::GetPartNumber() const {
 	return _GetAsciiParam(part_number, 16);
 }
 
-std::string CapeEeprom::GetVersion() {
+std::string_view CapeEeprom::GetVersion() const {
 	return _GetAsciiParam(version, 4);
 }
 
-std::string CapeEeprom::GetBoardNumber() {
+std::string_view CapeEeprom::GetBoardNumber() const {
 	return _GetAsciiParam(serial+8, 4);
 }
 
@@ -222,42 +404,57 @@ void CapeEeprom::SetBoardNumber(unsigned int n) {
 	memcpy(serial+8, temp, 4);
 }
 
-std::string CapeEeprom::GetSerialNumber() {
+std::string_view CapeEeprom::GetSerialNumber() const {
 	return _GetAsciiParam(serial, 12);
 }
 
-int CapeEeprom::Dump()
-{
-	int            i,j;
-	char           c;
-	unsigned char *p = (unsigned char*) this;
-	printf ("");
+int CapeEeprom::SetSerialNumber(int week, int year, std::string_view asmCode, unsigned int boardNumber) {
+	if (week < 1 || week > 53 || year < 0 || year > 99 || asmCode.size() > 4 || boardNumber > 9999) return -1;
+	char serialStr[13];
+	snprintf(serialStr, sizeof(serialStr), "%02d%02d%4.*s%04u", week, year, (int)asmCode.size(), asmCode.data(), boardNumber);
+	memcpy(serial, serialStr, 12);
+	return 0;
+}
 
-	for (i = 0; i < sizeof(CapeEeprom); i+=16)
-	{
-		if (i % 256 == 0)
-			printf ("     00 01 02 03 04 05 06 07 - 08 09 0a 0b 0c 0d 0e 0f\n");
-			printf ("%04x ", i);
-		for (j = 0; j < 16; j++)
-		{
-			if ((i+j)<sizeof(CapeEeprom)) {
-				printf ("%02x ", (int)*(p + i + j));
-				if (j == 7) printf ( "- ");
-			} else {
-				printf ("   ");
-				if (j == 7) printf ( "  ");
-			}
-		}
-		printf (" | ");
-		for (j = 0; j < 16 &&(i+j)<sizeof(CapeEeprom); j++)
-		{
-			c = *(p + i + j);
-			printf ("%c", c < 32 || c > 127 ? '.' : c);
-			if (j == 7) printf ( " ");
-		}
-		printf ("\n");
+int CapeEeprom::_SetAsciiParam(char *param, int length, std::string_view value) {
+	if (value.size() > (size_t)length) return -1;
+	memset(param, 0, length);
+	memcpy(param, value.data(), value.size());
+	return 0;
+}
+
+int CapeEeprom::SetBoardName(std::string_view name) {
+	return _SetAsciiParam(bname, sizeof(bname), name);
+}
+
+int CapeEeprom::SetPartNumber(std::string_view partNumber) {
+	return _SetAsciiParam(part_number, sizeof(part_number), partNumber);
+}
+
+int CapeEeprom::SetVersion(std::string_view version) {
+	return _SetAsciiParam(this->version, sizeof(this->version), version);
+}
+
+int CapeEeprom::FileName(char *out, size_t n, bool boardNumber) const {
+	std::string_view parts[] = {GetPartNumber(), "-", GetVersion(), "-", GetBoardNumber(), ".eep"};
+	size_t len = 0;
+	for (size_t i = 0; i < sizeof(parts)/sizeof(parts[0]); i++) {
+		if (!boardNumber && (i == 3 || i == 4)) continue;
+		if (len + parts[i].size() >= n) return -1;
+		memcpy(out + len, parts[i].data(), parts[i].size());
+		len += parts[i].size();
 	}
-	printf ("\n");
+	out[len] = '\0';
+	return len;
+}
+
+int CapeEeprom::Dump()
+{
+	uint8_t image[CAPE_EEPROM_SIZE];
+	Encode(image, sizeof(image));
+	
+	CapeFormatter formatter(stdout, 4096);
+	formatter.Dump(image, sizeof(image));
 	return 0;
 }
 
@@ -275,151 +472,143 @@ int CapeEeprom::_ReadUint16BE(unsigned char *buffer)
 	return value;
 }
 
-int CapeEeprom::_ParseLineData(char* cmd, char* c, SerialNumber &serialNumber) {
-	int val;
-	uint32_t high1, high2;
-	char pin[20], modes[20], pull[20], slew[20], rx[20], dir[20];
-	uint8_t mode;
-	uint16_t pinconfig;
-	bool valid;
+int CapeEeprom::_ParseLineData(SettingsTokenizer &t, const SettingsLine &l, SerialNumber &serialNumber) {
 	int paramValue = 0;
 	
-	if (strcmp(cmd, "board_name")==0) {
-		sscanf(c, "%100s \"%32[^\"]\"", cmd, bname);
-	} else if (strcmp(cmd, "version")==0) {
-		sscanf(c, "%100s \"%4[^\"]\"", cmd, version);
-	} else if (strcmp(cmd, "manufacturer")==0) {
-		sscanf(c, "%100s \"%16[^\"]\"", cmd, manufacturer);
-	} else if (strcmp(cmd, "part_number")==0) {
-		sscanf(c, "%100s \"%16[^\"]\"", cmd, part_number);
-	} else if (strcmp(cmd, "number_of_pins")==0) {
-		sscanf(c, "%100s %2d", cmd, &paramValue);
-		_WriteUint16BE(n_pins, paramValue);
-	} else if (strcmp(cmd, "assembly_code")==0) {
-		sscanf(c, "%100s \"%16[^\"]\"", cmd, &serialNumber.asm_code);
-	} else if (strcmp(cmd, "week_of_production")==0) {
+	switch (FindKeyword(l.keyword)) {
+	case KW_BOARD_NAME:
+		ParseString(t, l, bname, sizeof(bname));
+		break;
+	case KW_VERSION:
+		ParseString(t, l, version, sizeof(version));
+		break;
+	case KW_MANUFACTURER:
+		ParseString(t, l, manufacturer, sizeof(manufacturer));
+		break;
+	case KW_PART_NUMBER:
+		ParseString(t, l, part_number, sizeof(part_number));
+		break;
+	case KW_NUMBER_OF_PINS:
+		if (ParseNumber(t, l, 0, 99, paramValue)) _WriteUint16BE(n_pins, paramValue);
+		break;
+	case KW_ASSEMBLY_CODE:
+		ParseString(t, l, serialNumber.asm_code, sizeof(serialNumber.asm_code) - 1);
+		break;
+	case KW_WEEK_OF_PRODUCTION:
 		serialNumber.week_of_production = 0;
-		sscanf(c, "%100s %2d", cmd, &serialNumber.week_of_production);
-	} else if (strcmp(cmd, "year_of_production")==0) {
+		ParseNumber(t, l, 1, 53, serialNumber.week_of_production);
+		break;
+	case KW_YEAR_OF_PRODUCTION:
 		serialNumber.year_of_production = -1;
-		sscanf(c, "%100s %2d", cmd, &serialNumber.year_of_production);
-	} else if (strcmp(cmd, "board_number")==0) {
+		ParseNumber(t, l, 0, 99, serialNumber.year_of_production);
+		break;
+	case KW_BOARD_NUMBER:
 		serialNumber.board_number = -1;
-		sscanf(c, "%100s %4d", cmd, &serialNumber.board_number);
-	} else if (strcmp(cmd, "vdd_3V3b_current")==0) {
-		sscanf(c, "%100s %4d", cmd, &paramValue);
-		_WriteUint16BE(vdd_3v3, paramValue);
-	} else if (strcmp(cmd, "vdd_5v_current")==0) {
-		sscanf(c, "%100s %4d", cmd, &paramValue);
-		_WriteUint16BE(vdd_5v, paramValue); 
-	} else if (strcmp(cmd, "sys_5v_current")==0) {
-		sscanf(c, "%100s %4d", cmd, &paramValue);
-		_WriteUint16BE(sys_5v, paramValue);
-	} else if (strcmp(cmd, "dc_supplied")==0) {
-		sscanf(c, "%100s %4d", cmd, &paramValue);
-		_WriteUint16BE(dc, paramValue);
-	} else if (strcmp(cmd, "pinconfig")==0) {
-		#ifdef linux
-		sscanf(c, "%20s %19s %d %19s %19s %19s %19s", cmd, pin, &mode, slew, dir, pull, rx);
-		#else
-		sscanf(c, "%50s %19s %19s %19s %19s %19s %19s", cmd, pin, modes, slew, dir, pull, rx);
-		sscanf(modes, "%d", &mode);
-		#endif
-		int i = 0,j = 0;
-		sscanf(pin, "%*[Pp]%d%*[_]%d", &i, &j);
-		//printf("%s, %s, %d, %s, %s, %s, %s %d %d\n", cmd, pin, mode, slew, dir, pull, rx, i, j);
+		ParseNumber(t, l, 0, 9999, serialNumber.board_number);
+		break;
+	case KW_VDD_3V3B_CURRENT:
+		if (ParseNumber(t, l, 0, 65535, paramValue)) _WriteUint16BE(vdd_3v3, paramValue);
+		break;
+	case KW_VDD_5V_CURRENT:
+		if (ParseNumber(t, l, 0, 65535, paramValue)) _WriteUint16BE(vdd_5v, paramValue); 
+		break;
+	case KW_SYS_5V_CURRENT:
+		if (ParseNumber(t, l, 0, 65535, paramValue)) _WriteUint16BE(sys_5v, paramValue);
+		break;
+	case KW_DC_SUPPLIED:
+		if (ParseNumber(t, l, 0, 65535, paramValue)) _WriteUint16BE(dc, paramValue);
+		break;
+	case KW_PINCONFIG: {
+		// pinconfig PIN MODE SLEW DIRECTION PULL RX
+		if (!CheckArgCount(t, l, 6)) return -1;
 		
-		int k = (i-8)*64+j;
-		if (i<8 || i>9 || k > 128 || pin_order[k] == -1) {
-			 printf("Error at pin config: pin not recognised for %s\n", pin);
-			 return -1;
+		std::string_view pin = l.args[0];
+		int k = ParsePin(pin);
+		if (k < 0) {
+			t.Error(pin.data(), "pin not recognised for %.*s", SV(pin));
+			return -1;
+		}
+		
+		bool valid = true;
+		uint16_t pinconfig = PIN_UNUSED;
+		int mode;
+		
+		if (ParseNumber(t, l, l.args[1], 0, 7, mode)) {
+			pinconfig |= mode;
 		} else {
-			valid = true;
-			pinconfig = PIN_UNUSED;
-			
-			if (mode <= 7) {
-				pinconfig |= mode;
-			} else {
-				printf("Error at pin config: mode not recognised for %s\n", pin);
-				pinconfig |= 7;
-				valid=false;
-			}
-			
-			if (strcmp(dir, "INPUT")==0) {
-				pinconfig |= PINDIR_INPUT;
-			} else if (strcmp(dir, "OUTPUT")==0) {
-				pinconfig |= PINDIR_OUTPUT;
-			} else if (strcmp(dir, "BDIR")==0) {
-				pinconfig |= PINDIR_BDIR;
-			} else {
-				pinconfig |= PINDIR_INPUT;
-				printf("Error at pin config: direction not recognised for %s\n", pin);
-				valid=false;
-			}
-			
-			if (strcmp(pull, "PULL_DOWN")==0) {
-				pinconfig |= PINPULL_DOWN | PINPULL_ENABLE;
-			} else if (strcmp(pull, "PULL_UP")==0) {
-				pinconfig |= PINPULL_UP | PINPULL_ENABLE;
-			} else if (strcmp(pull, "PULL_NONE")==0) {
-				pinconfig |= PINPULL_DOWN | PINPULL_DISABLE;
-			} else {
-				pinconfig |= PINPULL_DOWN | PINPULL_ENABLE;
-				printf("Error at pin config: pull type not recognised for %s\n", pin);
-				valid=false;
-			}
-			
-			if (strcmp(slew, "SLOW")==0) {
-				pinconfig |= PINSLEW_SLOW;
-			} else if (strcmp(slew, "FAST")==0) {
-				pinconfig |= PINSLEW_FAST;
-			} else {
-				pinconfig |= PINSLEW_SLOW;
-				printf("Error at pin config: slew rate not recognised for %s\n", pin);
-				valid=false;
-			}
-			
-			if (strcmp(rx, "RX_ENABLE")==0) {
-				pinconfig |= PINRX_ENABLE;
-			} else if (strcmp(rx, "RX_DISABLE")==0) {
-				pinconfig |= PINRX_DISABLE;
+			valid = false;
+		}
+		
+		// Each option token must be of its column class
+		static const char * const optionNames[] = {"slew rate", "direction", "pull type", "rx"};
+		for (int o = OPT_SLEW; o <= OPT_RX; o++) {
+			std::string_view v = l.args[2 + o];
+			int i = pin_option_hash.Find(pin_options, v);
+			if (i >= 0 && pin_options[i].id == o) {
+				pinconfig |= pin_options[i].value;
 			} else {
-				pinconfig |= PINRX_DISABLE;
-				printf("Error at pin config: rx %s, not recognised for %s\n", rx, pin);
-				valid=false;
-			}
-			
-			if (valid) {
-				pinconfig |= PIN_USED;
-				_WriteUint16BE((unsigned char*)(pins + pin_order[k] * (int)2), pinconfig);
+				t.Error(v.data(), "pin config %s %.*s not recognised for %.*s", optionNames[o], SV(v), SV(pin));
+				valid = false;
 			}
 		}
+		
+		if (valid) {
+			pinconfig |= PIN_USED;
+			_WriteUint16BE((unsigned char*)(pins + k * 2), pinconfig);
+		}
+		break;
+	}
+	default:
+		t.Error(l.keyword.data(), "unknown keyword %.*s", SV(l.keyword));
+		return -1;
 	} 
+	return 0;
 }
 
-CapeEeprom::CapeEeprom(const std::string inFile) {
-	FILE * fp;
-	char * line = NULL;
-	char * c = NULL;
-	size_t len = 0;
-	int/*ssize_t*/ read;
-	char *comment = NULL;
-	int atomct = 2;
-	int linect = 0;
-	char * command = (char*) malloc (101);
-	int i;
+int CapeEeprom::ListVariants(const std::string inFile, std::vector<std::string> &variants)
+{
+	SettingsFile settingsFile(inFile.c_str());
+	if (!settingsFile.IsOpen()) return -1;
 	
-	memset(pin_order, -1, 128);
-	for (int i = 0; i < 74; i++) {
-		pin_order[(bb_pins[i][0]-8)*64+bb_pins[i][1]] = i;
+	// Syntax errors are reported when variants are parsed
+	SettingsTokenizer tokenizer(settingsFile.Data(), settingsFile.Size(), true);
+	SettingsLine line;
+	while (tokenizer.Next(line)) {
+		if (FindKeyword(line.keyword) != KW_VARIANT || line.argCount != 1) continue;
+		std::string name(line.args[0]);
+		if (std::find(variants.begin(), variants.end(), name) == variants.end()) variants.push_back(name);
 	}
-	
-	memset(this, 0, sizeof(CapeEeprom));
+	return 0;
+}
+
+CapeEeprom::CapeEeprom() {
+	memcpy(magic, cape_magic, sizeof(magic));
+	rev[0] = 'A';
+	rev[1] = '1';
+}
+
+// Settings cache entry, compiled image without serial number and serial
+// number settings
+struct CacheEntry {
+	uint8_t image[CAPE_EEPROM_SIZE];
+	char asm_code[5];
+	int32_t week_of_production;
+	int32_t year_of_production;
+	int32_t board_number;
+};
+
+CapeEeprom::CapeEeprom(const std::string inFile, const CapeLoadOptions &options) {
+	CapeStatTimer loadTimer(options.stats, STAT_LOAD);
 	
 	if (inFile.find(".txt") == std::string::npos) {
-		// Read file as eeprom image
+		// Read file as eeprom image, with integrity trailer if it has one
+		uint8_t image[CAPE_SEALED_SIZE];
 		std::ifstream eepFile(inFile.c_str(), std::ios::in | std::ios::binary);
-		eepFile.read ((char*)this, sizeof(CapeEeprom));
+		eepFile.read ((char*)image, sizeof(image));
+		if (CheckCapeImageSeal(image, eepFile.gcount()) == CAPE_SEAL_BAD)
+			printf("Error: %s integrity check failed\n", inFile.c_str());
+		else if (Decode(image, eepFile.gcount()) < 0) 
+			printf("Error: %s is not cape EEPROM image\n", inFile.c_str());
 		eepFile.close();
 		return;
 	}
@@ -431,55 +620,135 @@ CapeEeprom::CapeEeprom(const std::string inFile) {
 		-1
 	};
 	
-	magic[0] = 0xAA;
-	magic[1] = 0x55;
-	magic[2] = 0x33;
-	magic[3] = 0xEE;
+	memcpy(magic, cape_magic, sizeof(magic));
 	rev[0] = 'A';
 	rev[1] = '1';
 	
-	std::ifstream settingsFile(inFile.c_str());
-	if (!settingsFile) {
+	SettingsFile settingsFile(inFile.c_str());
+	if (!settingsFile.IsOpen()) {
 		printf("Error opening input file\n");
+		memset(magic, 0, sizeof(magic));
 		return;
 	}
 
-	std::string sline;
-	while ( std::getline (settingsFile, sline) )
-    {
-		char line[1000];
-		memcpy(line, sline.c_str(), sline.length() + 1);
-		linect++;
-		c = line;
-		
-		for (i=0; i<sline.length(); i++) if (c[i]=='#') c[i]='\0';
-		
-		while (isspace(*c)) ++c;
-		
-		if (*c=='\0' || *c=='\n' || *c=='\r') {
-			//empty line, do nothing
-		} else if (isalnum (*c)) {
-			sscanf(c, "%100s", command);
-			
+	CacheEntry entry;
+	std::string cacheKey;
+	bool cached = false;
+	if (options.cache) {
+		cacheKey = options.cache->Key(settingsFile.Data(), settingsFile.Size(), options.variant ? options.variant : "");
+		cached = options.cache->Load(cacheKey, &entry, sizeof(entry)) && Decode(entry.image, sizeof(entry.image)) == 0;
+		if (cached) {
+			memcpy(serialNumber.asm_code, entry.asm_code, sizeof(serialNumber.asm_code));
+			serialNumber.asm_code[sizeof(serialNumber.asm_code) - 1] = '\0';
+			serialNumber.week_of_production = entry.week_of_production;
+			serialNumber.year_of_production = entry.year_of_production;
+			serialNumber.board_number = entry.board_number;
+		}
+	}
+	
+	// Parse settings unless loaded from cache
+	if (!cached) {
+		SettingsTokenizer tokenizer(settingsFile.Data(), settingsFile.Size());
+		SettingsLine line;
+		// Base settings are followed by variant blocks, only lines of 
+		// selected variant block override base settings
+		std::string_view variant = options.variant ? options.variant : "";
+		bool selected = true, found = variant.empty();
+		// Pins configured in current block, variant may override base pin
+		PinSet blockPins;
+		while (tokenizer.Next(line)) {
 #ifdef DEBUG
-			printf("Processing line %u: %s", linect, c);
-			if ((*(c+strlen(c)-1))!='\n') printf("\n");
+			printf("Processing line %u: %.*s\n", line.line, SV(line.text));
 #endif
-			
-			_ParseLineData(command, c, serialNumber);
-		} else printf("Can't parse line %u: %s", linect, c);
+			int keyword = FindKeyword(line.keyword);
+			if (keyword == KW_VARIANT) {
+				selected = CheckArgCount(tokenizer, line, 1) && line.args[0] == variant;
+				found |= selected;
+				blockPins = PinSet();
+				continue;
+			} else if (!selected) {
+				continue;
+			} else if (keyword == KW_PINCONFIG && line.argCount > 0) {
+				int k = ParsePin(line.args[0]);
+				if (k >= 0 && blockPins.Test(k)) {
+					tokenizer.Error(line.args[0].data(), "duplicate pinconfig for %.*s", SV(line.args[0]));
+					continue;
+				}
+				if (k >= 0) blockPins.Set(k);
+			}
+			if (options.stats) {
+				int errors = tokenizer.ErrorCount();
+				{
+					CapeStatTimer timer(options.stats, STAT_PARSE_LINE);
+					_ParseLineData(tokenizer, line, serialNumber);
+				}
+				options.stats->Count(STAT_LINES_PARSED);
+				if (keyword == KW_PINCONFIG && tokenizer.ErrorCount() > errors) options.stats->Count(STAT_PINCONFIG_ERRORS);
+			} else {
+				_ParseLineData(tokenizer, line, serialNumber);
+			}
+		}
+		if (!found) {
+			fprintf(stderr, "Error: variant %s not found in %s\n", options.variant, inFile.c_str());
+			memset(magic, 0, sizeof(magic));
+			return;
+		}
+		
+		// Settings with errors are not cached, so errors are reported again
+		if (options.cache && tokenizer.ErrorCount() == 0) {
+			Encode(entry.image, sizeof(entry.image));
+			memcpy(entry.asm_code, serialNumber.asm_code, sizeof(entry.asm_code));
+			entry.week_of_production = serialNumber.week_of_production;
+			entry.year_of_production = serialNumber.year_of_production;
+			entry.board_number = serialNumber.board_number;
+			options.cache->Store(cacheKey, &entry, sizeof(entry));
+		}
+	}
+	
+	// Pin rules of compiled settings, reported also when loaded from cache
+	uint8_t image[CAPE_EEPROM_SIZE];
+	std::vector<PinViolation> violations;
+	Encode(image, sizeof(image));
+	int pinErrors = ValidateCapeImage(image, &violations);
+	if (options.violations) options.violations->insert(options.violations->end(), violations.begin(), violations.end());
+	else PrintPinViolations(stdout, violations);
+	if (options.stats) options.stats->Count(STAT_PIN_RULE_ERRORS, pinErrors);
+	
+	if (options.requireSerialNumber && (serialNumber.week_of_production < 1 || serialNumber.year_of_production < 0 || 
+		serialNumber.board_number < 0)) {
+		fprintf(stderr, "Error: %s has no board_number, week_of_production or year_of_production\n", inFile.c_str());
+		memset(magic, 0, sizeof(magic));
+		return;
 	}
 	
+	CapeStatTimer serialTimer(options.stats, STAT_SERIAL);
 	if ( serialNumber.week_of_production < 1 || serialNumber.year_of_production < 0 ) {
 		time_t t = time(NULL);
-		struct tm tm = *gmtime(&t);
+		struct tm tm;
+		gmtime_r(&t, &tm);
 		if ( serialNumber.week_of_production < 1 ) serialNumber.week_of_production = GetWeek(&tm);
 		if ( serialNumber.year_of_production < 0 ) serialNumber.year_of_production = tm.tm_year - 100;
 	}
 	
-	if (serialNumber.board_number < 0) {
+	if (serialNumber.board_number >= 0 && options.allocator) {
+		// Allocator would give same board number to another board
+		fprintf(stderr, "Error: board_number of %s can not be used with board number allocator\n", inFile.c_str());
+		memset(magic, 0, sizeof(magic));
+		return;
+	}
+	if (serialNumber.board_number < 0 && options.allocator) {
+		// Unique board number from allocator shared by all stations, first
+		// of range when image is made for several boards
+		serialNumber.board_number = options.allocator->AllocateRange(serialNumber.asm_code, 
+			serialNumber.week_of_production, serialNumber.year_of_production, options.boardCount);
+		if (serialNumber.board_number < 0) {
+			fprintf(stderr, "Cannot allocate board number\n");
+			memset(magic, 0, sizeof(magic));
+			return;
+		}
+	} else if (serialNumber.board_number < 0) {
 		serialNumber.board_number = 0;
-		#ifdef linux
+		#ifdef __linux__
 		// if not defined in settings file generate random board number
 		uint32_t sn;
 		std::ifstream random_file("/dev/urandom", std::ios::in | std::ios::binary);
@@ -494,6 +763,4 @@ CapeEeprom::CapeEeprom(const std::string inFile) {
 	char serialStr[13];
 	sprintf(serialStr, "%02d%02d%4s%04d", serialNumber.week_of_production, serialNumber.year_of_production, serialNumber.asm_code, serialNumber.board_number);
 	memcpy(serial, serialStr, 12);
-
-    settingsFile.close();
 }
\ No newline at end of file
@@ -22,22 +22,78 @@ along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
 #define CAPE_EEPROM_H
 
 #include <string>
+#include <string_view>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include "cape_format.h"
 
 //#define DEBUG	1 
 
+// Longest output file name "part_number-version-board_number.eep" with
+// terminating zero
+#define CAPE_FILE_NAME_MAX	32
+
+struct ProgramResult;
+class BoardNumberAllocator;
+class SettingsCache;
+class CapeStats;
+class SettingsTokenizer;
+struct SettingsLine;
+struct PinViolation;
+
+// Optional services used when loading settings file
+struct CapeLoadOptions {
+	BoardNumberAllocator *allocator = NULL;	// board numbers missing in settings
+	unsigned int boardCount = 1;			// consecutive board numbers taken from allocator
+	SettingsCache *cache = NULL;			// compiled settings cache
+	const char *variant = NULL;				// variant block applied over base settings
+	CapeStats *stats = NULL;				// phase times and counters of load
+	std::vector<PinViolation> *violations = NULL;	// pin rule violations, printed if NULL
+	bool requireSerialNumber = false;		// fail if settings miss board number, week or year
+};
+
+// EEPROM image of cape. Objects hold no shared state, so different
+// objects can be built, printed and encoded concurrently.
 class CapeEeprom
 {
 public:
-	CapeEeprom(const std::string inFile);
-	int Write(const char *fname);
-	int Print();
+	CapeEeprom();
+	CapeEeprom(const std::string inFile, const CapeLoadOptions &options = CapeLoadOptions());
+	// Appends names of variant blocks of settings file, in order of appearance
+	static int ListVariants(const std::string inFile, std::vector<std::string> &variants);
+	// Returns false if loading failed, image has no valid header
+	bool IsValid() const;
+	// Encodes EEPROM image to out, returns image size or -1 if n is too small
+	int Encode(uint8_t *out, size_t n) const;
+	// Encodes EEPROM image with integrity trailer to out, returns image size
+	// (CAPE_SEALED_SIZE) or -1 if n is too small
+	int EncodeSealed(uint8_t *out, size_t n) const;
+	// Decodes EEPROM image, returns -1 if n is too small, header is invalid
+	// or integrity trailer does not match image
+	int Decode(const uint8_t *in, size_t n);
+	// Writes image file, with integrity trailer if sealed
+	int Write(const char *fname, CapeStats *stats = NULL, bool sealed = false);
+	int Program(const char *device, int pageSize, ProgramResult *result, CapeStats *stats = NULL, bool sealed = false);
+	int Print(CapePrintFormat format = CAPE_PRINT_TEXT);
 	int Dump();
-	std::string GetBoardName();
-	std::string GetPartNumber();
-	std::string GetVersion();
-	std::string GetBoardNumber();
+	// Fields without padding zeros, valid while object exists
+	std::string_view GetBoardName() const;
+	std::string_view GetPartNumber() const;
+	std::string_view GetVersion() const;
+	std::string_view GetBoardNumber() const;
 	void SetBoardNumber(unsigned int n);
-	std::string GetSerialNumber();
+	std::string_view GetSerialNumber() const;
+	// Sets serial number WWYYAAAANNNN, returns -1 if any part is out of range
+	int SetSerialNumber(int week, int year, std::string_view asmCode, unsigned int boardNumber);
+	// Field setters return -1 if value is longer than field
+	int SetBoardName(std::string_view name);
+	int SetPartNumber(std::string_view partNumber);
+	int SetVersion(std::string_view version);
+	// Writes output file name "part_number-version.eep", with board number
+	// before extension if boardNumber, to out. Returns length of name or -1
+	// if n is too small.
+	int FileName(char *out, size_t n, bool boardNumber) const;
 private:
 	struct SerialNumber {
 		char asm_code[5];
@@ -45,24 +101,26 @@ private:
 		int year_of_production;
 		int board_number;
 	};
-	int _ParseLineData(char* cmd, char* c, SerialNumber &serial);
+	int _ParseLineData(SettingsTokenizer &t, const SettingsLine &l, SerialNumber &serial);
 	int _WriteUint16BE(unsigned char *buffer, int value);
 	int _ReadUint16BE(unsigned char *buffer);
-	std::string _GetAsciiParam(char *param, int lenth);
+	static std::string_view _GetAsciiParam(const char *param, int lenth);
+	static int _SetAsciiParam(char *param, int length, std::string_view value);
 	
-	unsigned char magic[4];
-	unsigned char rev[2];
-	char   bname[32];
-	char   version[4];
-	char   manufacturer[16];
-	char   part_number[16];
-	unsigned char   n_pins[2];
-	char   serial[12];
-	unsigned char   pins[148];
-	unsigned char   vdd_3v3[2];
-	unsigned char   vdd_5v[2];
-	unsigned char   sys_5v[2];
-	unsigned char   dc[2];
+	// Image fields, all zero until set
+	unsigned char magic[4] = {};
+	unsigned char rev[2] = {};
+	char   bname[32] = {};
+	char   version[4] = {};
+	char   manufacturer[16] = {};
+	char   part_number[16] = {};
+	unsigned char   n_pins[2] = {};
+	char   serial[12] = {};
+	unsigned char   pins[148] = {};
+	unsigned char   vdd_3v3[2] = {};
+	unsigned char   vdd_5v[2] = {};
+	unsigned char   sys_5v[2] = {};
+	unsigned char   dc[2] = {};
 };
 
 #endif
\ No newline at end of file
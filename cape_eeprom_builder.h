@@ -0,0 +1,138 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CAPE_EEPROM_BUILDER_H
+#define CAPE_EEPROM_BUILDER_H
+
+#include <string_view>
+#include "cape_eeprom_layout.h"
+#include "pin_validator.h"
+
+// Compile time EEPROM image builder for embedding images in firmware.
+// Methods mirror settings file keywords and use same pin encoding as
+// settings parser. Invalid values, duplicate pins and images violating
+// error level pin rules throw, which is compile error when image is
+// built in constant expression:
+//
+//	constexpr std::array<uint8_t, CAPE_EEPROM_SIZE> image = CapeImageBuilder()
+//		.BoardName("Cape eeprom demo")
+//		.Version("00A0")
+//		.PartNumber("bb-cape-s123")
+//		.WeekOfProduction(38).YearOfProduction(17).BoardNumber(1)
+//		.PinConfig("P9_12", 7, CapeSlew::SLOW, CapeDirection::OUTPUT, CapePull::PULL_DOWN, CapeRx::RX_DISABLE)
+//		.Image();
+
+enum class CapeSlew : uint16_t {
+	SLOW = PINSLEW_SLOW,
+	FAST = PINSLEW_FAST
+};
+
+enum class CapeDirection : uint16_t {
+	INPUT = PINDIR_INPUT,
+	OUTPUT = PINDIR_OUTPUT,
+	BDIR = PINDIR_BDIR
+};
+
+enum class CapePull : uint16_t {
+	PULL_DOWN = PINPULL_DOWN | PINPULL_ENABLE,
+	PULL_UP = PINPULL_UP | PINPULL_ENABLE,
+	PULL_NONE = PINPULL_DOWN | PINPULL_DISABLE
+};
+
+enum class CapeRx : uint16_t {
+	RX_ENABLE = PINRX_ENABLE,
+	RX_DISABLE = PINRX_DISABLE
+};
+
+class CapeImageBuilder
+{
+public:
+	constexpr CapeImageBuilder() : image(), asmCode{'0', '0', '0', '0'}, week(-1), year(-1), board(-1) {
+		for (int i = 0; i < CAPE_MAGIC_LEN; i++) image[CAPE_MAGIC_OFS + i] = cape_magic[i];
+		image[CAPE_REV_OFS] = 'A';
+		image[CAPE_REV_OFS + 1] = '1';
+	}
+	
+	constexpr CapeImageBuilder &BoardName(std::string_view s) { return _Ascii(CAPE_BNAME_OFS, CAPE_BNAME_LEN, s); }
+	constexpr CapeImageBuilder &Version(std::string_view s) { return _Ascii(CAPE_VERSION_OFS, CAPE_VERSION_LEN, s); }
+	constexpr CapeImageBuilder &Manufacturer(std::string_view s) { return _Ascii(CAPE_MANUFACTURER_OFS, CAPE_MANUFACTURER_LEN, s); }
+	constexpr CapeImageBuilder &PartNumber(std::string_view s) { return _Ascii(CAPE_PART_NUMBER_OFS, CAPE_PART_NUMBER_LEN, s); }
+	constexpr CapeImageBuilder &NumberOfPins(int n) { return _Uint16(CAPE_N_PINS_OFS, _Check(n, 0, 99)); }
+	constexpr CapeImageBuilder &Vdd3v3bCurrent(int mA) { return _Uint16(CAPE_VDD_3V3_OFS, _Check(mA, 0, 65535)); }
+	constexpr CapeImageBuilder &Vdd5vCurrent(int mA) { return _Uint16(CAPE_VDD_5V_OFS, _Check(mA, 0, 65535)); }
+	constexpr CapeImageBuilder &Sys5vCurrent(int mA) { return _Uint16(CAPE_SYS_5V_OFS, _Check(mA, 0, 65535)); }
+	constexpr CapeImageBuilder &DcSupplied(int mA) { return _Uint16(CAPE_DC_OFS, _Check(mA, 0, 65535)); }
+	
+	constexpr CapeImageBuilder &AssemblyCode(std::string_view s) {
+		if (s.size() > 4) throw "assembly code longer than 4 characters";
+		// Right aligned as "%4s" of settings parser
+		for (int i = 0; i < 4; i++) asmCode[i] = i < 4 - (int)s.size() ? ' ' : s[i - (4 - s.size())];
+		return *this;
+	}
+	constexpr CapeImageBuilder &WeekOfProduction(int n) { week = _Check(n, 1, 53); return *this; }
+	constexpr CapeImageBuilder &YearOfProduction(int n) { year = _Check(n, 0, 99); return *this; }
+	constexpr CapeImageBuilder &BoardNumber(int n) { board = _Check(n, 0, 9999); return *this; }
+	
+	constexpr CapeImageBuilder &PinConfig(std::string_view pin, int mode, CapeSlew slew, CapeDirection dir, CapePull pull, CapeRx rx) {
+		int k = CapePinIndex(pin);
+		if (image[CAPE_PINS_OFS + k * 2] & (PIN_USED >> 8)) throw "duplicate pinconfig of pin";
+		uint16_t pinconfig = PIN_USED | _Check(mode, 0, 7) | (uint16_t)slew | (uint16_t)dir | (uint16_t)pull | (uint16_t)rx;
+		return _Uint16(CAPE_PINS_OFS + k * 2, pinconfig);
+	}
+	
+	// Returns image, serial number is made of production week, year, 
+	// assembly code and board number which must be set
+	constexpr std::array<uint8_t, CAPE_EEPROM_SIZE> Image() const {
+		if (week < 0 || year < 0 || board < 0) throw "week, year of production and board number must be set";
+		if (CheckPinRules(image.data(), [](const PinRule &, const PinSet &, int) {})) throw "image violates pin rule";
+		std::array<uint8_t, CAPE_EEPROM_SIZE> out = image;
+		const int digits[] = {week / 10, week % 10, year / 10, year % 10};
+		for (int i = 0; i < 4; i++) out[CAPE_SERIAL_OFS + i] = '0' + digits[i];
+		for (int i = 0; i < 4; i++) out[CAPE_SERIAL_OFS + 4 + i] = asmCode[i];
+		for (int i = 0, b = board; i < 4; i++, b /= 10) out[CAPE_SERIAL_OFS + 11 - i] = '0' + b % 10;
+		return out;
+	}
+	
+private:
+	static constexpr int _Check(int v, int min, int max) {
+		if (v < min || v > max) throw "value out of range";
+		return v;
+	}
+	
+	constexpr CapeImageBuilder &_Ascii(int ofs, int length, std::string_view s) {
+		if ((int)s.size() > length) throw "string longer than field";
+		for (int i = 0; i < length; i++) image[ofs + i] = i < (int)s.size() ? s[i] : 0;
+		return *this;
+	}
+	
+	constexpr CapeImageBuilder &_Uint16(int ofs, int value) {
+		image[ofs] = value >> 8;
+		image[ofs + 1] = value;
+		return *this;
+	}
+	
+	std::array<uint8_t, CAPE_EEPROM_SIZE> image;
+	char asmCode[4];
+	int week;
+	int year;
+	int board;
+};
+
+#endif
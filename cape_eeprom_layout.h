@@ -0,0 +1,123 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CAPE_EEPROM_LAYOUT_H
+#define CAPE_EEPROM_LAYOUT_H
+
+#include <stddef.h>
+#include <array>
+
+#if defined(_WIN32)
+ 
+typedef __int8              int8_t;
+typedef __int16             int16_t;
+typedef __int32             int32_t;
+typedef __int64             int64_t;
+typedef unsigned __int8     uint8_t;
+typedef unsigned __int16    uint16_t;
+typedef unsigned __int32    uint32_t;
+typedef unsigned __int64    uint64_t;
+ 
+#else
+#include <stdint.h>
+#endif
+
+// EEPROM image field offsets and sizes
+#define CAPE_MAGIC_OFS			0
+#define CAPE_MAGIC_LEN			4
+#define CAPE_REV_OFS			4
+#define CAPE_REV_LEN			2
+#define CAPE_BNAME_OFS			6
+#define CAPE_BNAME_LEN			32
+#define CAPE_VERSION_OFS		38
+#define CAPE_VERSION_LEN		4
+#define CAPE_MANUFACTURER_OFS	42
+#define CAPE_MANUFACTURER_LEN	16
+#define CAPE_PART_NUMBER_OFS	58
+#define CAPE_PART_NUMBER_LEN	16
+#define CAPE_N_PINS_OFS			74
+#define CAPE_SERIAL_OFS			76
+#define CAPE_SERIAL_LEN			12
+#define CAPE_PINS_OFS			88
+#define CAPE_PINS_LEN			148
+#define CAPE_VDD_3V3_OFS		236
+#define CAPE_VDD_5V_OFS			238
+#define CAPE_SYS_5V_OFS			240
+#define CAPE_DC_OFS				242
+#define CAPE_EEPROM_SIZE		244
+
+// Optional integrity trailer past dc: tag and CRC32C (big endian) of the
+// 244 byte image. Images with trailer are CAPE_SEALED_SIZE bytes.
+#define CAPE_CRC_TAG_OFS		244
+#define CAPE_CRC_TAG_LEN		4
+#define CAPE_CRC_OFS			248
+#define CAPE_SEALED_SIZE		252
+
+// Board number is last 4 characters of serial number
+#define CAPE_BOARD_NUMBER_OFS	(CAPE_SERIAL_OFS + 8)
+#define CAPE_BOARD_NUMBER_LEN	4
+
+static constexpr uint8_t cape_magic[CAPE_MAGIC_LEN] = {0xAA, 0x55, 0x33, 0xEE};
+static constexpr uint8_t cape_crc_tag[CAPE_CRC_TAG_LEN] = {'C', 'R', 'C', 'C'};
+
+#define PIN_UNUSED			(0x0000 << 15)
+#define PIN_USED			(0x0001 << 15)
+#define PINDIR_INPUT		(0x0001 << 13)
+#define PINDIR_OUTPUT		(0x0002 << 13)
+#define PINDIR_BDIR			(0x0003 << 13)
+#define PINSLEW_SLOW		(0x0001 << 6)
+#define PINSLEW_FAST		(0x0000 << 6)
+#define PINRX_DISABLE		(0x0000 << 5)
+#define PINRX_ENABLE		(0x0001 << 5)
+#define PINPULL_DOWN		(0x0000 << 4)
+#define PINPULL_UP			(0x0001 << 4)
+#define PINPULL_DISABLE		(0x0001 << 3)
+#define PINPULL_ENABLE		(0x0000 << 3)
+
+static constexpr uint8_t bb_pins[][2] = {
+	{9,22}, {9,21}, {9,18}, {9,17}, {9,42}, {8,35}, {8,33}, {8,31}, {8,32}, {9,19},
+	{9,20}, {9,26}, {9,24}, {9,41}, {8,19}, {8,13}, {8,14}, {8,17}, {9,11}, {9,13},
+	{8,25}, {8,24}, {8,5}, {8,6}, {8,23}, {8,22}, {8,3}, {8,4},{8,12},{8,11},
+	{8,16},{8,15},{9,15},{9,23},{9,14},{9,16},{9,12},{8,26},{8,21},{8,20},
+	{8,18},{8,7},{8,9},{8,10},{8,8},{8,45},{8,46},{8,43},{8,44},{8,41},
+	{8,42},{8,39},{8,40},{8,37},{8,38},{8,36},{8,34},{8,27},{8,29},{8,28},
+	{8,30},{9,29},{9,30},{9,28},{9,27},{9,31},{9,25},{9,39},{9,40},{9,37},
+	{9,38},{9,33},{9,36},{9,35}
+};
+
+#define BB_PIN_COUNT	(sizeof(bb_pins)/sizeof(bb_pins[0]))
+
+// Index of pin in bb_pins by header pin number (header-8)*64+pin, -1 if 
+// pin can not be used by cape, built at compile time.
+static constexpr std::array<int8_t, 128> MakePinOrder()
+{
+	std::array<int8_t, 128> order = {};
+	for (size_t i = 0; i < order.size(); i++) order[i] = -1;
+	for (size_t i = 0; i < BB_PIN_COUNT; i++) {
+		order[(bb_pins[i][0]-8)*64+bb_pins[i][1]] = i;
+	}
+	return order;
+}
+
+static constexpr std::array<int8_t, 128> pin_order = MakePinOrder();
+
+static_assert(BB_PIN_COUNT == 74, "cape EEPROM holds configuration for 74 pins");
+
+#endif
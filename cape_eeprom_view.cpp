@@ -0,0 +1,76 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cape_eeprom_view.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+bool CapeEepromView::IsValid() const
+{
+	return memcmp(p + CAPE_MAGIC_OFS, cape_magic, CAPE_MAGIC_LEN) == 0;
+}
+
+std::string_view CapeEepromView::_GetAsciiParam(int ofs, int length) const
+{
+	const char *s = (const char*)(p + ofs);
+	return std::string_view(s, strnlen(s, length));
+}
+
+CapeImageMap::CapeImageMap(const char *fname) : data(NULL), size(0), stride(CAPE_EEPROM_SIZE), count(0)
+{
+	struct stat st;
+	int fd = open(fname, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Cannot open file: %s\n", fname);
+		return;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size < CAPE_EEPROM_SIZE) {
+		fprintf(stderr, "File does not contain EEPROM image: %s\n", fname);
+		close(fd);
+		return;
+	}
+	
+	size = st.st_size;
+	void *m = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (m == MAP_FAILED) {
+		fprintf(stderr, "Cannot map file: %s\n", fname);
+		size = 0;
+		return;
+	}
+	madvise(m, size, MADV_SEQUENTIAL);
+	
+	data = (const uint8_t*)m;
+	// Second image of plain archive starts with magic, not trailer tag
+	if (size >= CAPE_SEALED_SIZE && memcmp(data + CAPE_CRC_TAG_OFS, cape_crc_tag, CAPE_CRC_TAG_LEN) == 0) 
+		stride = CAPE_SEALED_SIZE;
+	count = size / stride;
+	if (size % stride) 
+		fprintf(stderr, "Warning: %zu trailing bytes ignored in %s\n", size % stride, fname);
+}
+
+CapeImageMap::~CapeImageMap()
+{
+	if (data) munmap((void*)data, size);
+}
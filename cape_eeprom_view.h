@@ -0,0 +1,99 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CAPE_EEPROM_VIEW_H
+#define CAPE_EEPROM_VIEW_H
+
+#include <string_view>
+#include <iterator>
+#include "cape_eeprom_layout.h"
+
+// Read-only view of EEPROM image in memory, fields are decoded on access
+// without copying image data.
+class CapeEepromView
+{
+public:
+	CapeEepromView(const uint8_t *image) : p(image) {}
+	bool IsValid() const;
+	std::string_view GetRevision() const { return _GetAsciiParam(CAPE_REV_OFS, CAPE_REV_LEN); }
+	std::string_view GetBoardName() const { return _GetAsciiParam(CAPE_BNAME_OFS, CAPE_BNAME_LEN); }
+	std::string_view GetVersion() const { return _GetAsciiParam(CAPE_VERSION_OFS, CAPE_VERSION_LEN); }
+	std::string_view GetManufacturer() const { return _GetAsciiParam(CAPE_MANUFACTURER_OFS, CAPE_MANUFACTURER_LEN); }
+	std::string_view GetPartNumber() const { return _GetAsciiParam(CAPE_PART_NUMBER_OFS, CAPE_PART_NUMBER_LEN); }
+	std::string_view GetSerialNumber() const { return _GetAsciiParam(CAPE_SERIAL_OFS, CAPE_SERIAL_LEN); }
+	std::string_view GetBoardNumber() const { return _GetAsciiParam(CAPE_BOARD_NUMBER_OFS, CAPE_BOARD_NUMBER_LEN); }
+	int GetPinsUsed() const { return _ReadUint16BE(CAPE_N_PINS_OFS); }
+	uint16_t GetPinConfig(int i) const { return _ReadUint16BE(CAPE_PINS_OFS + i*2); }
+	int GetVdd3v3Current() const { return _ReadUint16BE(CAPE_VDD_3V3_OFS); }
+	int GetVdd5vCurrent() const { return _ReadUint16BE(CAPE_VDD_5V_OFS); }
+	int GetSys5vCurrent() const { return _ReadUint16BE(CAPE_SYS_5V_OFS); }
+	int GetDcSupplied() const { return _ReadUint16BE(CAPE_DC_OFS); }
+	const uint8_t *Data() const { return p; }
+private:
+	std::string_view _GetAsciiParam(int ofs, int length) const;
+	uint16_t _ReadUint16BE(int ofs) const { return (p[ofs] << 8) | p[ofs+1]; }
+	
+	const uint8_t *p;
+};
+
+// Memory mapped file of concatenated EEPROM images, such as readback dumps.
+// Images are 244 bytes, or CAPE_SEALED_SIZE bytes if first image has 
+// integrity trailer.
+class CapeImageMap
+{
+public:
+	class iterator {
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef CapeEepromView value_type;
+		typedef ptrdiff_t difference_type;
+		typedef const CapeEepromView* pointer;
+		typedef CapeEepromView reference;
+		
+		iterator(const uint8_t *image, size_t stride) : p(image), stride(stride) {}
+		CapeEepromView operator*() const { return CapeEepromView(p); }
+		iterator& operator++() { p += stride; return *this; }
+		bool operator==(const iterator &it) const { return p == it.p; }
+		bool operator!=(const iterator &it) const { return p != it.p; }
+	private:
+		const uint8_t *p;
+		size_t stride;
+	};
+
+	CapeImageMap(const char *fname);
+	~CapeImageMap();
+	bool IsOpen() const { return data != NULL; }
+	size_t Count() const { return count; }
+	// Size of one image in file
+	size_t Stride() const { return stride; }
+	CapeEepromView operator[](size_t i) const { return CapeEepromView(data + i*stride); }
+	iterator begin() const { return iterator(data, stride); }
+	iterator end() const { return iterator(data + count*stride, stride); }
+private:
+	CapeImageMap(const CapeImageMap&);
+	CapeImageMap& operator=(const CapeImageMap&);
+	
+	const uint8_t *data;
+	size_t size;
+	size_t stride;
+	size_t count;
+};
+
+#endif
@@ -0,0 +1,328 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cape_format.h"
+#include <string.h>
+
+#define SEPARATOR	"#####################################################\n"
+
+// Two hex digits and space for each byte value
+struct HexTable {
+	char hex[256][3];
+	char ascii[256];
+	
+	constexpr HexTable() : hex(), ascii() {
+		const char digits[] = "0123456789abcdef";
+		for (int i = 0; i < 256; i++) {
+			hex[i][0] = digits[i >> 4];
+			hex[i][1] = digits[i & 15];
+			hex[i][2] = ' ';
+			ascii[i] = (i < 32 || i > 127) ? '.' : i;
+		}
+	}
+};
+
+static constexpr HexTable hex_table;
+
+static const char * const slew_names[] = {"FAST", "SLOW"};
+static const char * const dir_names[] = {"INPUT", "INPUT", "OUTPUT", "BDIR"};
+static const char * const rx_names[] = {"RX_DISABLE", "RX_ENABLE"};
+
+static const char *PullName(uint16_t pinconfig)
+{
+	if (pinconfig & PINPULL_DISABLE) return "PULL_NONE";
+	return pinconfig & PINPULL_UP ? "PULL_UP" : "PULL_DOWN";
+}
+
+std::string CapePinConfigText(uint16_t pinconfig)
+{
+	if (!(pinconfig & PIN_USED)) return "unused";
+	char text[48];
+	snprintf(text, sizeof(text), "%d %s %s %s %s", pinconfig & 0x07, slew_names[(pinconfig & PINSLEW_SLOW) != 0], 
+		dir_names[(pinconfig >> 13) & 3], PullName(pinconfig), rx_names[(pinconfig & PINRX_ENABLE) != 0]);
+	return text;
+}
+
+int CapePrintFormatFromName(const char *name)
+{
+	if (strcmp(name, "text") == 0) return CAPE_PRINT_TEXT;
+	if (strcmp(name, "json") == 0) return CAPE_PRINT_JSON;
+	if (strcmp(name, "csv") == 0) return CAPE_PRINT_CSV;
+	return -1;
+}
+
+CapeFormatter::CapeFormatter(FILE *out, size_t capacity) : out(out), buffer(capacity), used(0)
+{
+}
+
+CapeFormatter::~CapeFormatter()
+{
+	Flush();
+}
+
+void CapeFormatter::Flush()
+{
+	if (used) fwrite(buffer.data(), 1, used, out);
+	used = 0;
+}
+
+// Returns space for n bytes at end of buffer
+char *CapeFormatter::_Reserve(size_t n)
+{
+	if (used + n > buffer.size()) {
+		Flush();
+		if (n > buffer.size()) buffer.resize(n);
+	}
+	return buffer.data() + used;
+}
+
+void CapeFormatter::_Append(std::string_view s)
+{
+	memcpy(_Reserve(s.size()), s.data(), s.size());
+	used += s.size();
+}
+
+void CapeFormatter::_AppendPadded(std::string_view s, size_t width)
+{
+	char *p = _Reserve(s.size() > width ? s.size() : width);
+	memcpy(p, s.data(), s.size());
+	if (s.size() < width) memset(p + s.size(), ' ', width - s.size());
+	used += s.size() > width ? s.size() : width;
+}
+
+void CapeFormatter::_AppendUint(unsigned long v)
+{
+	char digits[20];
+	int n = 0;
+	do {
+		digits[sizeof(digits) - ++n] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	_Append(std::string_view(digits + sizeof(digits) - n, n));
+}
+
+void CapeFormatter::_AppendPinName(int i)
+{
+	char *p = _Reserve(5);
+	int n = 0;
+	p[n++] = 'P';
+	p[n++] = '0' + bb_pins[i][0];
+	p[n++] = '_';
+	if (bb_pins[i][1] >= 10) p[n++] = '0' + bb_pins[i][1] / 10;
+	p[n++] = '0' + bb_pins[i][1] % 10;
+	used += n;
+}
+
+void CapeFormatter::_AppendJsonString(std::string_view s)
+{
+	static const char digits[] = "0123456789abcdef";
+	// Worst case every character escaped as \u00XX
+	char *p = _Reserve(s.size() * 6 + 2);
+	size_t n = 0;
+	p[n++] = '"';
+	for (size_t i = 0; i < s.size(); i++) {
+		unsigned char c = s[i];
+		if (c == '"' || c == '\\') {
+			p[n++] = '\\';
+			p[n++] = c;
+		} else if (c < 32 || c > 126) {
+			memcpy(p + n, "\\u00", 4);
+			p[n+4] = digits[c >> 4];
+			p[n+5] = digits[c & 15];
+			n += 6;
+		} else {
+			p[n++] = c;
+		}
+	}
+	p[n++] = '"';
+	used += n;
+}
+
+void CapeFormatter::_AppendCsvString(std::string_view s)
+{
+	char *p = _Reserve(s.size() * 2 + 2);
+	size_t n = 0;
+	p[n++] = '"';
+	for (size_t i = 0; i < s.size(); i++) {
+		if (s[i] == '"') p[n++] = '"';
+		p[n++] = s[i];
+	}
+	p[n++] = '"';
+	used += n;
+}
+
+void CapeFormatter::Header(CapePrintFormat format)
+{
+	if (format == CAPE_PRINT_CSV) 
+		_Append("index,source,status,valid,board_name,version,manufacturer,part_number,serial,pins_used,"
+			"vdd_3v3b_current,vdd_5v_current,sys_5v_current,dc_supplied,pins\n");
+}
+
+void CapeFormatter::Print(const CapeEepromView &cape, CapePrintFormat format, size_t index, 
+	std::string_view source, std::string_view status)
+{
+	switch (format) {
+	case CAPE_PRINT_JSON: _PrintJson(cape, index, source, status); break;
+	case CAPE_PRINT_CSV: _PrintCsv(cape, index, source, status); break;
+	default: _PrintText(cape);
+	}
+}
+
+void CapeFormatter::_PrintText(const CapeEepromView &cape)
+{
+	_Append(SEPARATOR);
+	_Append("Cape Name         : "); _Append(cape.GetBoardName()); _Append("\n");
+	_Append("Cape Version      : "); _Append(cape.GetVersion()); _Append("\n");
+	_Append("Cape Manufacturer : "); _Append(cape.GetManufacturer()); _Append("\n");
+	_Append("Part Number       : "); _Append(cape.GetPartNumber()); _Append("\n");
+	_Append("Serial Number     : "); _Append(cape.GetSerialNumber()); _Append("\n");
+	_Append("Pins Used         : "); _AppendUint(cape.GetPinsUsed()); _Append("\n");
+	_Append("VDD_3V3B Current  : "); _AppendUint(cape.GetVdd3v3Current()); _Append(" mA\n");
+	_Append("VDD_5V Current    : "); _AppendUint(cape.GetVdd5vCurrent()); _Append(" mA\n");
+	_Append("SYS_5V Current    : "); _AppendUint(cape.GetSys5vCurrent()); _Append(" mA\n");
+	_Append("Supplied Current  : "); _AppendUint(cape.GetDcSupplied()); _Append(" mA\n");
+	_Append(SEPARATOR);
+	_Append("Cape pins: \n");
+	for (size_t i = 0; i < BB_PIN_COUNT; i++) {
+		uint16_t pinconfig = cape.GetPinConfig(i);
+		if (!(pinconfig & PIN_USED)) continue;
+		size_t start = used;
+		_AppendPinName(i);
+		_AppendPadded("", 7 - (used - start));
+		_AppendUint(pinconfig & 0x07);
+		_Append("  ");
+		_AppendPadded(slew_names[(pinconfig & PINSLEW_SLOW) != 0], 7);
+		_AppendPadded(dir_names[(pinconfig >> 13) & 3], 8);
+		_AppendPadded(PullName(pinconfig), 11);
+		_Append(rx_names[(pinconfig & PINRX_ENABLE) != 0]);
+		_Append("\n");
+	}
+	_Append("\n");
+}
+
+void CapeFormatter::_PrintJson(const CapeEepromView &cape, size_t index, std::string_view source, std::string_view status)
+{
+	_Append("{\"index\":"); _AppendUint(index);
+	if (!source.empty()) {
+		_Append(",\"source\":"); _AppendJsonString(source);
+	}
+	if (!status.empty()) {
+		_Append(",\"status\":"); _AppendJsonString(status);
+	}
+	_Append(cape.IsValid() ? ",\"valid\":true" : ",\"valid\":false");
+	_Append(",\"board_name\":"); _AppendJsonString(cape.GetBoardName());
+	_Append(",\"version\":"); _AppendJsonString(cape.GetVersion());
+	_Append(",\"manufacturer\":"); _AppendJsonString(cape.GetManufacturer());
+	_Append(",\"part_number\":"); _AppendJsonString(cape.GetPartNumber());
+	_Append(",\"serial\":"); _AppendJsonString(cape.GetSerialNumber());
+	_Append(",\"pins_used\":"); _AppendUint(cape.GetPinsUsed());
+	_Append(",\"vdd_3v3b_current\":"); _AppendUint(cape.GetVdd3v3Current());
+	_Append(",\"vdd_5v_current\":"); _AppendUint(cape.GetVdd5vCurrent());
+	_Append(",\"sys_5v_current\":"); _AppendUint(cape.GetSys5vCurrent());
+	_Append(",\"dc_supplied\":"); _AppendUint(cape.GetDcSupplied());
+	_Append(",\"pins\":[");
+	bool first = true;
+	for (size_t i = 0; i < BB_PIN_COUNT; i++) {
+		uint16_t pinconfig = cape.GetPinConfig(i);
+		if (!(pinconfig & PIN_USED)) continue;
+		_Append(first ? "{\"pin\":\"" : ",{\"pin\":\"");
+		_AppendPinName(i);
+		_Append("\",\"mode\":"); _AppendUint(pinconfig & 0x07);
+		_Append(",\"slew\":\""); _Append(slew_names[(pinconfig & PINSLEW_SLOW) != 0]);
+		_Append("\",\"direction\":\""); _Append(dir_names[(pinconfig >> 13) & 3]);
+		_Append("\",\"pull\":\""); _Append(PullName(pinconfig));
+		_Append("\",\"rx\":\""); _Append(rx_names[(pinconfig & PINRX_ENABLE) != 0]);
+		_Append("\"}");
+		first = false;
+	}
+	_Append("]}\n");
+}
+
+void CapeFormatter::_PrintCsv(const CapeEepromView &cape, size_t index, std::string_view source, std::string_view status)
+{
+	_AppendUint(index); _Append(",");
+	_AppendCsvString(source); _Append(",");
+	_AppendCsvString(status);
+	_Append(cape.IsValid() ? ",1," : ",0,");
+	_AppendCsvString(cape.GetBoardName()); _Append(",");
+	_AppendCsvString(cape.GetVersion()); _Append(",");
+	_AppendCsvString(cape.GetManufacturer()); _Append(",");
+	_AppendCsvString(cape.GetPartNumber()); _Append(",");
+	_AppendCsvString(cape.GetSerialNumber()); _Append(",");
+	_AppendUint(cape.GetPinsUsed()); _Append(",");
+	_AppendUint(cape.GetVdd3v3Current()); _Append(",");
+	_AppendUint(cape.GetVdd5vCurrent()); _Append(",");
+	_AppendUint(cape.GetSys5vCurrent()); _Append(",");
+	_AppendUint(cape.GetDcSupplied()); _Append(",");
+	// Pins as PIN:MODE:SLEW:DIRECTION:PULL:RX separated with spaces
+	bool first = true;
+	for (size_t i = 0; i < BB_PIN_COUNT; i++) {
+		uint16_t pinconfig = cape.GetPinConfig(i);
+		if (!(pinconfig & PIN_USED)) continue;
+		if (!first) _Append(" ");
+		_AppendPinName(i);
+		_Append(":"); _AppendUint(pinconfig & 0x07);
+		_Append(":"); _Append(slew_names[(pinconfig & PINSLEW_SLOW) != 0]);
+		_Append(":"); _Append(dir_names[(pinconfig >> 13) & 3]);
+		_Append(":"); _Append(PullName(pinconfig));
+		_Append(":"); _Append(rx_names[(pinconfig & PINRX_ENABLE) != 0]);
+		first = false;
+	}
+	_Append("\n");
+}
+
+void CapeFormatter::Dump(const uint8_t *data, size_t size)
+{
+	// Each line is offset, 16 hex bytes, separators and 16 characters
+	const size_t lineLength = 5 + 16*3 + 2 + 3 + 16 + 1 + 1;
+	static const char header[] = "     00 01 02 03 04 05 06 07 - 08 09 0a 0b 0c 0d 0e 0f\n";
+	
+	for (size_t i = 0; i < size; i += 16) {
+		if (i % 256 == 0) _Append(std::string_view(header, sizeof(header) - 1));
+		
+		char *p = _Reserve(lineLength);
+		char *start = p;
+		size_t n = size - i < 16 ? size - i : 16;
+		
+		for (int shift = 12; shift >= 0; shift -= 4) *p++ = "0123456789abcdef"[(i >> shift) & 15];
+		*p++ = ' ';
+		for (size_t j = 0; j < 16; j++) {
+			if (j < n) {
+				memcpy(p, hex_table.hex[data[i + j]], 3);
+			} else {
+				memset(p, ' ', 3);
+			}
+			p += 3;
+			if (j == 7) {
+				memcpy(p, j < n ? "- " : "  ", 2);
+				p += 2;
+			}
+		}
+		memcpy(p, " | ", 3);
+		p += 3;
+		for (size_t j = 0; j < n; j++) {
+			*p++ = hex_table.ascii[data[i + j]];
+			if (j == 7) *p++ = ' ';
+		}
+		*p++ = '\n';
+		used += p - start;
+	}
+	_Append("\n");
+}
@@ -0,0 +1,75 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CAPE_FORMAT_H
+#define CAPE_FORMAT_H
+
+#include <stdio.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "cape_eeprom_view.h"
+
+enum CapePrintFormat {
+	CAPE_PRINT_TEXT,
+	CAPE_PRINT_JSON,	// one JSON object per image per line
+	CAPE_PRINT_CSV		// header line and one row per image
+};
+
+// Returns format for name text, json or csv, -1 if unknown
+int CapePrintFormatFromName(const char *name);
+// Decoded pin configuration as "MODE SLEW DIRECTION PULL RX", "unused" 
+// if pin is not marked used
+std::string CapePinConfigText(uint16_t pinconfig);
+
+// Formats decoded images and hex dumps of many images into one large
+// buffer, which is written to output file when full and on destruction.
+class CapeFormatter
+{
+public:
+	CapeFormatter(FILE *out, size_t capacity = 1 << 20);
+	~CapeFormatter();
+	// Header line of format, if any
+	void Header(CapePrintFormat format);
+	// Source (file or device) and status of image are added to JSON and CSV
+	// records if not empty
+	void Print(const CapeEepromView &cape, CapePrintFormat format, size_t index = 0, 
+		std::string_view source = std::string_view(), std::string_view status = std::string_view());
+	// Hex and ASCII dump of size bytes
+	void Dump(const uint8_t *data, size_t size);
+	void Flush();
+private:
+	void _PrintText(const CapeEepromView &cape);
+	void _PrintJson(const CapeEepromView &cape, size_t index, std::string_view source, std::string_view status);
+	void _PrintCsv(const CapeEepromView &cape, size_t index, std::string_view source, std::string_view status);
+	char *_Reserve(size_t n);
+	void _Append(std::string_view s);
+	void _AppendPadded(std::string_view s, size_t width);
+	void _AppendUint(unsigned long v);
+	void _AppendPinName(int i);
+	void _AppendJsonString(std::string_view s);
+	void _AppendCsvString(std::string_view s);
+	
+	FILE *out;
+	std::vector<char> buffer;
+	size_t used;
+};
+
+#endif
@@ -0,0 +1,252 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cape_server.h"
+#include "cape_eeprom_layout.h"
+#include "eeprom_programmer.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <algorithm>
+
+#define SERVER_BACKLOG	64
+
+CapeServer::CapeServer(const CapeLoadOptions &options, bool sealed) : options(options), sealed(sealed)
+{
+}
+
+int CapeServer::Load(const char *fname)
+{
+	std::vector<std::string> variants;
+	if (std::string(fname).find(".txt") != std::string::npos) CapeEeprom::ListVariants(fname, variants);
+	if (variants.empty()) variants.push_back("");
+	
+	for (const std::string &v : variants) {
+		CapeLoadOptions o = options;
+		o.variant = v.empty() ? NULL : v.c_str();
+		Template t = {"", "", CapeEeprom(fname, o)};
+		if (!t.cape.IsValid()) {
+			fprintf(stderr, "ERROR: Cannot load %s%s%s.\n", fname, v.empty() ? "" : " variant ", v.c_str());
+			return -1;
+		}
+		t.partNumber = t.cape.GetPartNumber();
+		t.description = t.partNumber + " " + std::string(t.cape.GetVersion()) + " " + std::string(t.cape.GetBoardName());
+		if (_Find(t.partNumber)) {
+			fprintf(stderr, "ERROR: Part number %s of %s is already loaded.\n", t.partNumber.c_str(), fname);
+			return -1;
+		}
+		templates.push_back(t);
+	}
+	return 0;
+}
+
+const CapeServer::Template *CapeServer::_Find(const std::string &partNumber) const
+{
+	for (const Template &t : templates) 
+		if (t.partNumber == partNumber) return &t;
+	return NULL;
+}
+
+static void Reply(std::string &reply, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void Reply(std::string &reply, const char *format, ...)
+{
+	char line[SERVER_MAX_REQUEST];
+	va_list ap;
+	va_start(ap, format);
+	vsnprintf(line, sizeof(line), format, ap);
+	va_end(ap);
+	reply += line;
+}
+
+// Parses board number argument, returns -1 if missing or invalid
+static int ParseBoardNumber(const char *s)
+{
+	char *end;
+	if (!s || !*s) return -1;
+	unsigned long n = strtoul(s, &end, 10);
+	return (*end || n > 9999) ? -1 : n;
+}
+
+void CapeServer::_Request(char *line, std::string &reply) const
+{
+	char *save;
+	char *cmd = strtok_r(line, " \t\r", &save);
+	if (!cmd) {
+		Reply(reply, "ERR empty request\n");
+		return;
+	}
+	
+	if (strcmp(cmd, "LIST") == 0) {
+		Reply(reply, "OK %zu\n", templates.size());
+		for (const Template &t : templates) Reply(reply, "%s\n", t.description.c_str());
+		return;
+	}
+	
+	bool program = strcmp(cmd, "PROGRAM") == 0;
+	if (!program && strcmp(cmd, "IMAGE") != 0) {
+		Reply(reply, "ERR unknown request %s\n", cmd);
+		return;
+	}
+	const char *part = strtok_r(NULL, " \t\r", &save);
+	int bn = ParseBoardNumber(strtok_r(NULL, " \t\r", &save));
+	const Template *t = part ? _Find(part) : NULL;
+	if (!t) {
+		Reply(reply, "ERR unknown part number %s\n", part ? part : "");
+		return;
+	} else if (bn < 0) {
+		Reply(reply, "ERR invalid board number\n");
+		return;
+	}
+	
+	CapeEeprom cape(t->cape);
+	cape.SetBoardNumber(bn);
+	if (!program) {
+		uint8_t image[CAPE_SEALED_SIZE];
+		size_t size = sealed ? CAPE_SEALED_SIZE : CAPE_EEPROM_SIZE;
+		if (sealed) cape.EncodeSealed(image, size);
+		else cape.Encode(image, size);
+		Reply(reply, "OK %zu\n", size);
+		reply.append((const char*)image, size);
+		return;
+	}
+	
+	const char *device = strtok_r(NULL, " \t\r", &save);
+	const char *pageArg = strtok_r(NULL, " \t\r", &save);
+	int pageSize = pageArg ? atoi(pageArg) : EEPROM_PAGE_SIZE;
+	if (!device || pageSize <= 0) {
+		Reply(reply, "ERR missing EEPROM path or invalid page size\n");
+		return;
+	}
+	if (std::find(devices.begin(), devices.end(), device) == devices.end()) {
+		Reply(reply, "ERR EEPROM path %s is not allowed\n", device);
+		return;
+	}
+	ProgramResult r;
+	if (cape.Program(device, pageSize, &r, options.stats, sealed) == 0) 
+		Reply(reply, "OK %d %d\n", r.pagesWritten, r.pagesTotal);
+	else 
+		Reply(reply, "ERR programming %s failed, %d of %d pages written\n", device, r.pagesWritten, r.pagesTotal);
+}
+
+// Writes all of data, returns -1 on error
+static int SendFully(int fd, const char *data, size_t size)
+{
+	while (size > 0) {
+		ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		data += n;
+		size -= n;
+	}
+	return 0;
+}
+
+void CapeServer::_Serve(int fd) const
+{
+	char buffer[SERVER_MAX_REQUEST];
+	size_t used = 0;
+	std::string reply;
+	
+	for (;;) {
+		ssize_t n = recv(fd, buffer + used, sizeof(buffer) - used, 0);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) break;
+		used += n;
+		
+		// Replies of all complete requests of buffer are sent at once
+		reply.clear();
+		char *start = buffer, *end = buffer + used, *nl;
+		while ((nl = (char*)memchr(start, '\n', end - start)) != NULL) {
+			*nl = '\0';
+			_Request(start, reply);
+			start = nl + 1;
+		}
+		if (start == buffer && used == sizeof(buffer)) {
+			Reply(reply, "ERR request longer than %d bytes\n", SERVER_MAX_REQUEST);
+			SendFully(fd, reply.data(), reply.size());
+			break;
+		}
+		used = end - start;
+		memmove(buffer, start, used);
+		if (!reply.empty() && SendFully(fd, reply.data(), reply.size()) < 0) break;
+	}
+	close(fd);
+}
+
+int CapeServer::Run(const char *socketPath)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path too long: %s\n", socketPath);
+		return -1;
+	}
+	strcpy(addr.sun_path, socketPath);
+	
+	// Stale socket of previous server is replaced, socket of running server
+	// and any other file are not
+	struct stat st;
+	if (lstat(socketPath, &st) == 0 && S_ISSOCK(st.st_mode)) {
+		int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (probe < 0) {
+			fprintf(stderr, "Cannot create socket: %s (%s)\n", socketPath, strerror(errno));
+			return -1;
+		}
+		int ret = connect(probe, (struct sockaddr*)&addr, sizeof(addr));
+		int err = errno;
+		close(probe);
+		if (ret == 0) {
+			fprintf(stderr, "Server is already running on socket: %s\n", socketPath);
+			return -1;
+		}
+		if (err == ECONNREFUSED) unlink(socketPath);
+	}
+	
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, SERVER_BACKLOG) < 0) {
+		fprintf(stderr, "Cannot listen on socket: %s (%s)\n", socketPath, strerror(errno));
+		if (fd >= 0) close(fd);
+		return -1;
+	}
+	
+	for (;;) {
+		int client = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+		if (client < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			fprintf(stderr, "Cannot accept connection: %s (%s)\n", socketPath, strerror(errno));
+			break;
+		}
+		std::thread(&CapeServer::_Serve, this, client).detach();
+	}
+	close(fd);
+	return -1;
+}
@@ -0,0 +1,76 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CAPE_SERVER_H
+#define CAPE_SERVER_H
+
+#include <string>
+#include <vector>
+#include "cape_eeprom.h"
+
+#define SERVER_MAX_REQUEST	512
+
+// Server of images of settings files loaded once, on Unix domain socket.
+// Each client connection is served by its own thread and may send any
+// number of requests, one per line:
+//   IMAGE part_number board_number
+//     reply "OK 244\n" followed by 244 byte image, or "OK 252\n" followed
+//     by image with integrity trailer if server is sealed
+//   PROGRAM part_number board_number eeprom_path [page_size]
+//     reply "OK pages_written pages_total\n" after image, with integrity
+//     trailer if server is sealed, is written and verified; eeprom_path
+//     must be one of devices allowed at server start
+//   LIST
+//     reply "OK count\n" followed by one "part_number version board_name"
+//     line per template
+// Errors are replied as "ERR message\n", connection stays open.
+class CapeServer
+{
+public:
+	CapeServer(const CapeLoadOptions &options, bool sealed = false);
+	// Loads settings file, or all variants of it, as templates keyed by
+	// part number. Returns -1 if file or any variant can not be loaded or
+	// part number of any template is not unique.
+	int Load(const char *fname);
+	size_t Count() const { return templates.size(); }
+	// Allows PROGRAM requests to write EEPROM device path, clients can not
+	// program any other path
+	void AllowDevice(const char *path) { devices.push_back(path); }
+	// Serves clients on socket until error, returns -1
+	int Run(const char *socketPath);
+private:
+	struct Template {
+		std::string partNumber;
+		std::string description;	// LIST reply line
+		CapeEeprom cape;
+	};
+	const Template *_Find(const std::string &partNumber) const;
+	void _Serve(int fd) const;
+	// Handles one request line, appends reply to reply
+	void _Request(char *line, std::string &reply) const;
+	
+	CapeLoadOptions options;
+	bool sealed;
+	// Templates are not changed after Run, so are shared by all clients
+	std::vector<Template> templates;
+	std::vector<std::string> devices;
+};
+
+#endif
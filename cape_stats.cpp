@@ -0,0 +1,124 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cape_stats.h"
+#include "atomic_file.h"
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+
+static const char * const phase_names[STAT_PHASE_COUNT] = {
+	"load", "parse_line", "serial", "write", "program", "verify"
+};
+
+static const struct {
+	const char *metric;
+	const char *summary;
+	const char *help;
+} counter_names[STAT_COUNTER_COUNT] = {
+	{"eepcape_lines_parsed_total", "lines parsed", "Settings lines parsed."},
+	{"eepcape_pinconfig_errors_total", "pinconfig errors", "Pinconfig lines with errors."},
+	{"eepcape_pin_rule_errors_total", "pin rule errors", "Pin rule errors of compiled settings."},
+	{"eepcape_bytes_written_total", "bytes written", "Bytes written to image files and EEPROM devices."}
+};
+
+CapeStats::CapeStats()
+{
+	for (Phase &p : phases) {
+		p.ns = 0;
+		p.calls = 0;
+	}
+	for (std::atomic<uint64_t> &c : counters) c = 0;
+}
+
+void CapeStats::PrintSummary(FILE *f) const
+{
+	fprintf(f, "%-12s %10s %12s %12s\n", "PHASE", "CALLS", "TOTAL ms", "AVG us");
+	for (int i = 0; i < STAT_PHASE_COUNT; i++) {
+		uint64_t calls = Calls((CapeStatPhase)i), ns = Time((CapeStatPhase)i);
+		fprintf(f, "%-12s %10llu %12.3f %12.3f\n", phase_names[i], (unsigned long long)calls, 
+			ns / 1e6, calls ? ns / 1e3 / calls : 0.0);
+	}
+	for (int i = 0; i < STAT_COUNTER_COUNT; i++) 
+		fprintf(f, "%-23s %12llu\n", counter_names[i].summary, (unsigned long long)Counter((CapeStatCounter)i));
+}
+
+int CapeStats::WritePrometheus(const char *fname)
+{
+	std::lock_guard<std::mutex> guard(writeMutex);
+	FileLock lock(fname);
+	if (!lock.IsLocked()) return -1;
+	
+	// Sample lines "name{labels} value" of file
+	std::map<std::string, double> samples;
+	if (FILE *in = fopen(fname, "r")) {
+		char line[256];
+		while (fgets(line, sizeof(line), in)) {
+			char *value = strrchr(line, ' ');
+			if (line[0] == '#' || !value) continue;
+			*value = '\0';
+			samples[line] = strtod(value + 1, NULL);
+		}
+		fclose(in);
+	}
+	
+	char name[128];
+	uint64_t v;
+	for (int i = 0; i < STAT_PHASE_COUNT; i++) {
+		v = Time((CapeStatPhase)i);
+		snprintf(name, sizeof(name), "eepcape_phase_seconds_total{phase=\"%s\"}", phase_names[i]);
+		samples[name] += (v - writtenNs[i]) / 1e9;
+		writtenNs[i] = v;
+		v = Calls((CapeStatPhase)i);
+		snprintf(name, sizeof(name), "eepcape_phase_calls_total{phase=\"%s\"}", phase_names[i]);
+		samples[name] += v - writtenCalls[i];
+		writtenCalls[i] = v;
+	}
+	for (int i = 0; i < STAT_COUNTER_COUNT; i++) {
+		v = Counter((CapeStatCounter)i);
+		samples[counter_names[i].metric] += v - writtenCounters[i];
+		writtenCounters[i] = v;
+	}
+	
+	// Collector must never read partial file, data need not be durable
+	AtomicFile file(fname, false);
+	FILE *f = file.File();
+	if (!f) return -1;
+	
+	fprintf(f, "# HELP eepcape_phase_seconds_total Time spent in phase.\n");
+	fprintf(f, "# TYPE eepcape_phase_seconds_total counter\n");
+	for (int i = 0; i < STAT_PHASE_COUNT; i++) {
+		snprintf(name, sizeof(name), "eepcape_phase_seconds_total{phase=\"%s\"}", phase_names[i]);
+		fprintf(f, "%s %.9f\n", name, samples[name]);
+	}
+	fprintf(f, "# HELP eepcape_phase_calls_total Number of times phase ran.\n");
+	fprintf(f, "# TYPE eepcape_phase_calls_total counter\n");
+	for (int i = 0; i < STAT_PHASE_COUNT; i++) {
+		snprintf(name, sizeof(name), "eepcape_phase_calls_total{phase=\"%s\"}", phase_names[i]);
+		fprintf(f, "%s %.0f\n", name, samples[name]);
+	}
+	for (int i = 0; i < STAT_COUNTER_COUNT; i++) {
+		fprintf(f, "# HELP %s %s\n", counter_names[i].metric, counter_names[i].help);
+		fprintf(f, "# TYPE %s counter\n", counter_names[i].metric);
+		fprintf(f, "%s %.0f\n", counter_names[i].metric, samples[counter_names[i].metric]);
+	}
+	return file.Commit();
+}
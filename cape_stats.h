@@ -0,0 +1,106 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CAPE_STATS_H
+#define CAPE_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+// Timed phases of image generation and programming
+enum CapeStatPhase {
+	STAT_LOAD,			// settings or image file load, including parse and serial
+	STAT_PARSE_LINE,	// _ParseLineData of settings lines
+	STAT_SERIAL,		// serial number generation (allocator or /dev/urandom)
+	STAT_WRITE,			// image file writes
+	STAT_PROGRAM,		// EEPROM device reads and page writes
+	STAT_VERIFY,		// EEPROM device readback and compare
+	STAT_PHASE_COUNT
+};
+
+enum CapeStatCounter {
+	STAT_LINES_PARSED,
+	STAT_PINCONFIG_ERRORS,	// pinconfig lines with errors
+	STAT_PIN_RULE_ERRORS,	// pin rule errors of compiled settings
+	STAT_BYTES_WRITTEN,	// bytes written to image files and EEPROM devices
+	STAT_COUNTER_COUNT
+};
+
+// Process wide phase times and counters, shared by concurrent loads and
+// programming. All updates are relaxed atomic adds.
+class CapeStats
+{
+public:
+	CapeStats();
+	void AddTime(CapeStatPhase phase, uint64_t ns) {
+		phases[phase].ns.fetch_add(ns, std::memory_order_relaxed);
+		phases[phase].calls.fetch_add(1, std::memory_order_relaxed);
+	}
+	void Count(CapeStatCounter counter, uint64_t n = 1) {
+		counters[counter].fetch_add(n, std::memory_order_relaxed);
+	}
+	uint64_t Time(CapeStatPhase phase) const { return phases[phase].ns; }
+	uint64_t Calls(CapeStatPhase phase) const { return phases[phase].calls; }
+	uint64_t Counter(CapeStatCounter counter) const { return counters[counter]; }
+	// Prints table of phases and counters
+	void PrintSummary(FILE *f) const;
+	// Adds times and counters since last write of this object to values of
+	// Prometheus text format file, under lock of <file>.lock, so values of
+	// all runs add up and counters never go down. File is replaced 
+	// atomically, node exporter textfile collector never reads partial file.
+	int WritePrometheus(const char *fname);
+private:
+	struct Phase {
+		std::atomic<uint64_t> ns;
+		std::atomic<uint64_t> calls;
+	};
+	Phase phases[STAT_PHASE_COUNT];
+	std::atomic<uint64_t> counters[STAT_COUNTER_COUNT];
+	// Values already added to Prometheus file
+	std::mutex writeMutex;
+	uint64_t writtenNs[STAT_PHASE_COUNT] = {};
+	uint64_t writtenCalls[STAT_PHASE_COUNT] = {};
+	uint64_t writtenCounters[STAT_COUNTER_COUNT] = {};
+};
+
+// Adds monotonic time from construction to destruction to phase of stats,
+// does nothing if stats is NULL
+class CapeStatTimer
+{
+public:
+	CapeStatTimer(CapeStats *stats, CapeStatPhase phase) : stats(stats), phase(phase) {
+		if (stats) start = std::chrono::steady_clock::now();
+	}
+	~CapeStatTimer() {
+		if (stats) stats->AddTime(phase, std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count());
+	}
+	CapeStatTimer(const CapeStatTimer &) = delete;
+	CapeStatTimer &operator=(const CapeStatTimer &) = delete;
+private:
+	CapeStats *stats;
+	CapeStatPhase phase;
+	std::chrono::steady_clock::time_point start;
+};
+
+#endif
@@ -0,0 +1,277 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Regression checks run by make check, exits with failure on first failed
+// check. Benchmarks are in bench.cpp.
+//   concurrent_build: images built, encoded, decoded and printed on many
+//     threads at once are all correct (CapeEeprom holds no shared state)
+//   hot_path_alloc: SetBoardNumber, Encode and FileName make no heap
+//     allocations
+//   builder_image: image of compile time builder matches known bytes and
+//     image encoded from same settings file
+//   station_serials: two stations sharing board number allocator program
+//     boards with unique serial numbers, settings with board number are
+//     refused with allocator
+//   allocator_state: board numbers of empty and other assembly codes stay
+//     unique when state file is rewritten by another allocator
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <new>
+
+#include "cape_eeprom.h"
+#include "cape_eeprom_layout.h"
+#include "cape_eeprom_builder.h"
+#include "worker_pool.h"
+#include "board_number_allocator.h"
+#include "station.h"
+
+#define CHECK_IMAGES			4000
+#define CHECK_STATION_BOARDS	20
+
+// Counts all operator new calls of checks
+static std::atomic<size_t> allocations(0);
+
+void *operator new(size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *p = malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+static const char settings[] =
+	"board_name \"Check cape\"\n"
+	"version \"00A0\"\n"
+	"manufacturer \"CapeEverything\"\n"
+	"part_number \"bb-cape-check\"\n"
+	"assembly_code \"0003\"\n"
+	"week_of_production 38\n"
+	"year_of_production 17\n"
+	"board_number 1\n"
+	"number_of_pins 2\n"
+	"pinconfig P9_12 7 SLOW OUTPUT PULL_DOWN RX_DISABLE\n"
+	"pinconfig P8_07 7 FAST INPUT PULL_UP RX_ENABLE\n";
+
+// Same cape as settings above
+static constexpr std::array<uint8_t, CAPE_EEPROM_SIZE> builderImage = CapeImageBuilder()
+	.BoardName("Check cape")
+	.Version("00A0")
+	.Manufacturer("CapeEverything")
+	.PartNumber("bb-cape-check")
+	.AssemblyCode("0003")
+	.WeekOfProduction(38).YearOfProduction(17).BoardNumber(1)
+	.NumberOfPins(2)
+	.PinConfig("P9_12", 7, CapeSlew::SLOW, CapeDirection::OUTPUT, CapePull::PULL_DOWN, CapeRx::RX_DISABLE)
+	.PinConfig("P8_07", 7, CapeSlew::FAST, CapeDirection::INPUT, CapePull::PULL_UP, CapeRx::RX_ENABLE)
+	.Image();
+
+static_assert(builderImage[0] == 0xAA && builderImage[1] == 0x55 && builderImage[2] == 0x33 && builderImage[3] == 0xEE, 
+	"builder magic");
+static_assert(builderImage[CAPE_REV_OFS] == 'A' && builderImage[CAPE_REV_OFS + 1] == '1', "builder revision");
+static_assert(builderImage[CAPE_SERIAL_OFS] == '3' && builderImage[CAPE_SERIAL_OFS + 3] == '7' && 
+	builderImage[CAPE_SERIAL_OFS + 7] == '3' && builderImage[CAPE_SERIAL_OFS + 11] == '1', "builder serial number");
+static_assert(builderImage[CAPE_N_PINS_OFS] == 0 && builderImage[CAPE_N_PINS_OFS + 1] == 2, "builder number of pins");
+static_assert(builderImage[CAPE_PINS_OFS + CapePinIndex("P9_12") * 2] == 0xC0 && 
+	builderImage[CAPE_PINS_OFS + CapePinIndex("P9_12") * 2 + 1] == 0x47, "builder P9_12 pinconfig");
+static_assert(builderImage[CAPE_PINS_OFS + CapePinIndex("P8_07") * 2] == 0xA0 && 
+	builderImage[CAPE_PINS_OFS + CapePinIndex("P8_07") * 2 + 1] == 0x37, "builder P8_07 pinconfig");
+
+static std::string tmpDir;
+static int failures = 0;
+
+static void Result(const char *check, bool ok, const char *detail = "")
+{
+	fprintf(stderr, "%-20s %s%s%s\n", check, ok ? "ok" : "FAILED", *detail ? ": " : "", detail);
+	if (!ok) failures++;
+}
+
+static void CheckConcurrentBuild(const std::string &settingsFile)
+{
+	// More threads than cores, so loads are interleaved
+	unsigned int threads = 2 * std::thread::hardware_concurrency();
+	if (threads < 4) threads = 4;
+	std::atomic<size_t> failed(0);
+	RunParallel(CHECK_IMAGES, threads, [&](size_t i) {
+		CapeEeprom cape(settingsFile);
+		cape.SetBoardNumber(i % 10000);
+		uint8_t image[CAPE_EEPROM_SIZE];
+		cape.Encode(image, sizeof(image));
+		CapeEeprom decoded;
+		char bn[8];
+		snprintf(bn, sizeof(bn), "%04zu", i % 10000);
+		if (decoded.Decode(image, sizeof(image)) < 0 || decoded.GetBoardNumber() != bn || 
+			decoded.GetSerialNumber() != cape.GetSerialNumber() || decoded.GetPartNumber() != "bb-cape-check") 
+			failed++;
+		cape.Print();
+	});
+	char detail[64];
+	snprintf(detail, sizeof(detail), "%zu of %d wrong images on %u threads", failed.load(), CHECK_IMAGES, threads);
+	Result("concurrent_build", failed == 0, detail);
+}
+
+static void CheckHotPathAllocations(const std::string &settingsFile)
+{
+	CapeEeprom cape(settingsFile);
+	uint8_t image[CAPE_EEPROM_SIZE];
+	char fname[CAPE_FILE_NAME_MAX];
+	size_t allocated = allocations;
+	for (unsigned int i = 0; i < CHECK_IMAGES; i++) {
+		cape.SetBoardNumber(i % 10000);
+		cape.Encode(image, sizeof(image));
+		cape.FileName(fname, sizeof(fname), true);
+	}
+	char detail[64];
+	snprintf(detail, sizeof(detail), "%zu heap allocations", allocations - allocated);
+	Result("hot_path_alloc", allocations == allocated, detail);
+}
+
+static void CheckBuilderImage(const std::string &settingsFile)
+{
+	CapeEeprom cape(settingsFile);
+	uint8_t image[CAPE_EEPROM_SIZE];
+	cape.Encode(image, sizeof(image));
+	int ofs = 0;
+	while (ofs < CAPE_EEPROM_SIZE && image[ofs] == builderImage[ofs]) ofs++;
+	char detail[64] = "";
+	if (ofs < CAPE_EEPROM_SIZE) 
+		snprintf(detail, sizeof(detail), "differs at offset %d: %02X, parser %02X", ofs, builderImage[ofs], image[ofs]);
+	Result("builder_image", ofs == CAPE_EEPROM_SIZE, detail);
+}
+
+static void CheckStationSerials(const std::string &settingsFile, const std::string &allocSettingsFile)
+{
+	std::string stateFile = tmpDir + "/board_numbers.db";
+	BoardNumberAllocator first(stateFile.c_str()), second(stateFile.c_str());
+	CapeLoadOptions options;
+	options.allocator = &first;
+	bool refused = !CapeEeprom(settingsFile, options).IsValid();
+	
+	std::vector<std::string> serials;
+	int failed = 0;
+	for (BoardNumberAllocator *allocator : {&first, &second}) {
+		options.allocator = allocator;
+		CapeEeprom cape(allocSettingsFile, options);
+		StationOptions so;
+		so.device = "sim:@station,twr=0,bus=100000000";
+		so.count = CHECK_STATION_BOARDS;
+		so.allocator = allocator;
+		so.serials = &serials;
+		failed += cape.IsValid() ? RunStation(cape, so) : CHECK_STATION_BOARDS;
+	}
+	
+	size_t unique = std::set<std::string>(serials.begin(), serials.end()).size();
+	char detail[96];
+	snprintf(detail, sizeof(detail), "%zu unique of %zu serials, %d failed boards%s", unique, serials.size(), failed, 
+		refused ? "" : ", fixed board number not refused");
+	Result("station_serials", refused && failed == 0 && unique == 2 * CHECK_STATION_BOARDS && unique == serials.size(), 
+		detail);
+}
+
+static void CheckAllocatorState()
+{
+	// Reserve of 1 makes each allocation read and rewrite state file
+	std::string stateFile = tmpDir + "/state.db";
+	BoardNumberAllocator a(stateFile.c_str(), 1), b(stateFile.c_str(), 1);
+	std::vector<int> empty, other;
+	for (int i = 0; i < 4; i++) {
+		BoardNumberAllocator &x = i % 2 ? b : a;
+		empty.push_back(x.Allocate("", 38, 17));
+		other.push_back(x.Allocate("0003", 38, 17));
+	}
+	bool unique = true;
+	for (const std::vector<int> *v : {&empty, &other}) 
+		for (size_t i = 0; i < v->size(); i++) 
+			unique &= (*v)[i] >= 0 && std::count(v->begin(), v->end(), (*v)[i]) == 1;
+	char detail[64];
+	snprintf(detail, sizeof(detail), "empty code %d %d %d %d", empty[0], empty[1], empty[2], empty[3]);
+	Result("allocator_state", unique, detail);
+}
+
+static int WriteFile(const std::string &fname, const char *data, size_t size)
+{
+	int fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return -1;
+	int ret = write(fd, data, size) == (ssize_t)size ? 0 : -1;
+	close(fd);
+	return ret;
+}
+
+int main()
+{
+	char dirTemplate[] = "/tmp/eepcape_check.XXXXXX";
+	if (!mkdtemp(dirTemplate)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	tmpDir = dirTemplate;
+	
+	// Same settings without board number, for allocator
+	std::string settingsFile = tmpDir + "/check.txt", allocSettingsFile = tmpDir + "/check_alloc.txt";
+	std::string allocSettings(settings);
+	allocSettings.erase(allocSettings.find("board_number 1\n"), strlen("board_number 1\n"));
+	if (WriteFile(settingsFile, settings, sizeof(settings) - 1) < 0 || 
+		WriteFile(allocSettingsFile, allocSettings.data(), allocSettings.size()) < 0) {
+		perror("eepcape_check");
+		return 1;
+	}
+	
+	// Output of Print is discarded, results go to stderr
+	int nullFd = open("/dev/null", O_WRONLY);
+	if (nullFd >= 0) {
+		fflush(stdout);
+		dup2(nullFd, STDOUT_FILENO);
+		close(nullFd);
+	}
+	
+	CheckConcurrentBuild(settingsFile);
+	CheckHotPathAllocations(settingsFile);
+	CheckBuilderImage(settingsFile);
+	CheckStationSerials(settingsFile, allocSettingsFile);
+	CheckAllocatorState();
+	
+	if (DIR *d = opendir(tmpDir.c_str())) {
+		while (struct dirent *e = readdir(d)) 
+			if (e->d_name[0] != '.') unlink((tmpDir + "/" + e->d_name).c_str());
+		closedir(d);
+	}
+	rmdir(tmpDir.c_str());
+	fprintf(stderr, "%d checks failed\n", failures);
+	return failures ? 1 : 0;
+}
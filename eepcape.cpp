@@ -23,32 +23,663 @@ along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
 #include <fstream>
 
 #include "cape_eeprom.h"
+#include "cape_eeprom_view.h"
+#include "eeprom_programmer.h"
+#include "worker_pool.h"
+#include "board_number_allocator.h"
+#include "eeprom_scanner.h"
+#include "settings_cache.h"
+#include "pin_validator.h"
+#include "image_diff.h"
+#include "image_store.h"
+#include "cape_stats.h"
+#include "cape_server.h"
+#include "cape_crc.h"
+#include "station.h"
+#include "manifest.h"
+#include <vector>
+#include <thread>
+#include <memory>
 
 #define VERSION "1.0"
 
 #define DEBUG
 
+#define USAGE "Usage: %s [-pda] [-f text|json|csv] [-nboard number[-last board number]] [-c count] [--program eeprom path [--page-size n]] [--alloc-db state file] [--cache dir] [--variant name] [--integrity] [--stats] [--stats-prom file] [input file] [output file]\n" \
+	"       %s --gang [-j jobs] [-nfirst board number] [--page-size n] [input file] [eeprom path]...\n" \
+	"       %s --scan[=root directory] [-j jobs] [-f text|json|csv]\n" \
+	"       %s --validate [-j jobs] [image file]\n" \
+	"       %s --verify [-j jobs] [image file]...\n" \
+	"       %s --station eeprom path [--no-wait] [-c count] [-nfirst board number] [--alloc-db state file] [--integrity] [--page-size n] [input file]\n" \
+	"       %s --diff golden file [--ignore-serial] [-j jobs] [image file]...\n" \
+	"       %s --store-add store [image file]... | --store-get store [-pd] serial [output file] | --store-list store [first WWYY [last WWYY]]\n" \
+	"       %s --serve socket path [--device eeprom path]... [--cache dir] [--integrity] [input file]...\n" \
+	"       %s --manifest csv file|- [--pack archive|tar] [--integrity] [input file] [output file]\n"
+
+#define MAX_BOARD_NUMBER	9999
+#define STATS_INTERVAL		10		// seconds between stats writes of server
+
+static const struct option long_options[] = {
+	{"print",	no_argument,		NULL, 'p'},
+	{"dump",	no_argument,		NULL, 'd'},
+	{"number",	required_argument,	NULL, 'n'},
+	{"count",	required_argument,	NULL, 'c'},
+	{"archive",	no_argument,		NULL, 'a'},
+	{"format",	required_argument,	NULL, 'f'},
+	{"program",	required_argument,	NULL, 'P'},
+	{"page-size",	required_argument,	NULL, 'S'},
+	{"gang",	no_argument,		NULL, 'G'},
+	{"jobs",	required_argument,	NULL, 'j'},
+	{"alloc-db",	required_argument,	NULL, 'A'},
+	{"scan",	optional_argument,	NULL, 's'},
+	{"cache",	required_argument,	NULL, 'C'},
+	{"variant",	required_argument,	NULL, 'V'},
+	{"validate",	no_argument,		NULL, 'L'},
+	{"diff",	required_argument,	NULL, 'D'},
+	{"ignore-serial",	no_argument,	NULL, 'I'},
+	{"store-add",	required_argument,	NULL, 'T'},
+	{"store-get",	required_argument,	NULL, 'E'},
+	{"store-list",	required_argument,	NULL, 'W'},
+	{"serve",	required_argument,	NULL, 'R'},
+	{"device",	required_argument,	NULL, 'U'},
+	{"integrity",	no_argument,		NULL, 'K'},
+	{"verify",	no_argument,		NULL, 'Y'},
+	{"station",	required_argument,	NULL, 'B'},
+	{"no-wait",	no_argument,		NULL, 'Z'},
+	{"manifest",	required_argument,	NULL, 'F'},
+	{"pack",	required_argument,	NULL, 'k'},
+	{"stats",	no_argument,		NULL, 'M'},
+	{"stats-prom",	required_argument,	NULL, 'X'},
+	{NULL, 0, NULL, 0}
+};
+
+#define SV(s)	(int)(s).size(), (s).data()
+
+// Phase times and counters of run, reported at exit
+static CapeStats *stats = NULL;
+static bool statsSummary = false;
+static const char *statsPromFile = NULL;
+
+static void ReportStats()
+{
+	if (statsSummary) stats->PrintSummary(stderr);
+	if (statsPromFile) stats->WritePrometheus(statsPromFile);
+}
+
+static void PrintBanner()
+{
+	fprintf (stderr, 
+		"\n******************************************************************************\n"
+		"BeagleBone Cape EEPROM Generator Ver:" VERSION "\n"
+		"(c) 2017, Milan Neskovic\n"
+		"License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>\n"
+		"This is free software: you are free to change and redistribute it.\n"
+		"There is NO WARRANTY, to the extent permitted by law.\n"
+		"******************************************************************************\n\n");
+}
+
+// List all images of concatenated EEPROM images file, or print and dump
+// all of them
+static int ListImages(const char *fname, bool print, bool dump, CapePrintFormat format)
+{
+	CapeImageMap images(fname);
+	if (!images.IsOpen()) return -1;
+	
+	if (print || dump) {
+		CapeFormatter formatter(stdout);
+		if (print) formatter.Header(format);
+		for (size_t i = 0; i < images.Count(); i++) {
+			if (print) formatter.Print(images[i], format, i, fname);
+			if (dump) formatter.Dump(images[i].Data(), CAPE_EEPROM_SIZE);
+		}
+		return 0;
+	}
+	
+	size_t n = 0, invalid = 0;
+	for (CapeEepromView cape : images) {
+		if (cape.IsValid()) {
+			printf("%8zu  %.*s  %-16.*s %-4.*s  %.*s\n", n, SV(cape.GetSerialNumber()), 
+				SV(cape.GetPartNumber()), SV(cape.GetVersion()), SV(cape.GetBoardName()));
+		} else {
+			printf("%8zu  invalid EEPROM header\n", n);
+			invalid++;
+		}
+		n++;
+	}
+	printf("%zu images, %zu invalid\n", n, invalid);
+	return 0;
+}
+
+// Checks all images of concatenated EEPROM images file against pin rules
+// concurrently, then reports violations of each image. Returns number of
+// images with errors.
+static int ValidateImages(const char *fname, unsigned int jobs)
+{
+	CapeImageMap images(fname);
+	if (!images.IsOpen()) return -1;
+	
+	// Images are checked in chunks, violations are formatted only for
+	// images which have any
+	const size_t chunk = 4096;
+	size_t n = images.Count();
+	std::vector<uint8_t> violated(n);
+	RunParallel((n + chunk - 1) / chunk, jobs, [&](size_t c) {
+		for (size_t i = c * chunk; i < n && i < (c + 1) * chunk; i++) {
+			int count = 0;
+			CheckPinRules(images[i].Data(), [&](const PinRule &, const PinSet &, int) { count++; });
+			violated[i] = count > 0;
+		}
+	});
+	
+	size_t failed = 0, warned = 0;
+	std::vector<PinViolation> violations;
+	for (size_t i = 0; i < n; i++) {
+		if (!violated[i]) continue;
+		char source[32];
+		snprintf(source, sizeof(source), "image %zu", i);
+		violations.clear();
+		ValidateCapeImage(images[i].Data(), &violations);
+		if (PrintPinViolations(stdout, violations, source)) failed++;
+		else warned++;
+	}
+	printf("%zu images, %zu with errors, %zu with warnings only\n", n, failed, warned);
+	return failed;
+}
+
+// Checks integrity trailers of all images of image files, single images or
+// archives. Returns number of images with bad or missing trailer.
+static int VerifyImages(char **files, int nFiles, unsigned int jobs)
+{
+	size_t total = 0, bad = 0, unsealed = 0, unreadable = 0;
+	std::vector<size_t> failed;
+	for (int f = 0; f < nFiles; f++) {
+		CapeImageMap images(files[f]);
+		if (!images.IsOpen()) {
+			unreadable++;
+			continue;
+		}
+		failed.clear();
+		VerifyCapeImages(images, jobs, failed);
+		for (size_t i : failed) {
+			bool sealed = CheckCapeImageSeal(images[i].Data(), images.Stride()) == CAPE_SEAL_BAD;
+			printf("%s[%zu]: %s\n", files[f], i, sealed ? "bad checksum" : "no checksum");
+			if (sealed) bad++;
+			else unsealed++;
+		}
+		total += images.Count();
+	}
+	printf("%zu images, %zu ok, %zu bad checksum, %zu without checksum", total, total - bad - unsealed, bad, unsealed);
+	if (unreadable) printf(", %zu files unreadable", unreadable);
+	printf("\n");
+	return bad + unsealed + unreadable;
+}
+
+// Compares all images of image files with golden image, printing differing
+// fields of each image which differs. Returns number of differing images.
+static int DiffImages(const CapeEeprom &golden, char **files, int nFiles, unsigned int flags, unsigned int jobs)
+{
+	uint8_t image[CAPE_EEPROM_SIZE];
+	golden.Encode(image, sizeof(image));
+	ImageDiff diff(image, flags);
+	
+	size_t total = 0, differ = 0, unreadable = 0;
+	std::vector<size_t> mismatches;
+	std::vector<ImageFieldDiff> fields;
+	for (int f = 0; f < nFiles; f++) {
+		CapeImageMap images(files[f]);
+		if (!images.IsOpen()) {
+			unreadable++;
+			continue;
+		}
+		mismatches.clear();
+		diff.FindMismatches(images, jobs, mismatches);
+		for (size_t i : mismatches) {
+			fields.clear();
+			diff.Diff(images[i].Data(), fields);
+			for (const ImageFieldDiff &d : fields) 
+				printf("%s[%zu]: %s: expected %s, actual %s\n", files[f], i, d.field.c_str(), d.expected.c_str(), d.actual.c_str());
+		}
+		total += images.Count();
+		differ += mismatches.size();
+	}
+	printf("%zu images, %zu identical, %zu differ", total, total - differ, differ);
+	if (unreadable) printf(", %zu files unreadable", unreadable);
+	printf("\n");
+	return differ + unreadable;
+}
+
+// Store commands: add images of image files, get image of one board by
+// serial number or list boards, optionally of range of production weeks
+static int StoreCommand(int cmd, const char *fname, char **args, int nArgs, bool print, bool dump)
+{
+	if (cmd == 'T') {
+		// Images of all files are added at once, nothing is added if any
+		// file can not be read
+		std::vector<std::unique_ptr<CapeImageMap> > maps;
+		std::vector<const uint8_t*> images;
+		int unreadable = 0;
+		for (int i = 0; i < nArgs; i++) {
+			maps.emplace_back(new CapeImageMap(args[i]));
+			if (!maps.back()->IsOpen()) {
+				fprintf(stderr, "ERROR: Images of %s can not be added.\n", args[i]);
+				unreadable++;
+				continue;
+			}
+			for (CapeEepromView cape : *maps.back()) images.push_back(cape.Data());
+		}
+		if (unreadable || images.empty()) {
+			if (!unreadable) fprintf(stderr, "ERROR: No images to add.\n");
+			return -1;
+		}
+		int n = CapeImageStore::Append(fname, images.data(), images.size());
+		if (n < 0) return -1;
+		
+		CapeImageStore s(fname);
+		fprintf(stderr, "%d images added, store has %zu boards, %zu base images\n", n, s.Count(), s.BaseCount());
+		return n == (int)images.size() ? 0 : -1;
+	}
+	
+	CapeImageStore s(fname);
+	if (!s.IsOpen()) return -1;
+	
+	if (cmd == 'E') {
+		long i = nArgs > 0 ? s.Find(args[0]) : -1;
+		if (i < 0) {
+			fprintf(stderr, "ERROR: Board %s not found in %s\n", nArgs > 0 ? args[0] : "", fname);
+			return -1;
+		}
+		uint8_t image[CAPE_EEPROM_SIZE];
+		s.Extract(i, image);
+		std::string outFile = nArgs > 1 ? args[1] : std::string(args[0]) + ".eep";
+		FILE *f = fopen(outFile.c_str(), "wb");
+		if (!f || fwrite(image, sizeof(image), 1, f) != 1) {
+			fprintf(stderr, "Cannot write file: %s\n", outFile.c_str());
+			if (f) fclose(f);
+			return -1;
+		}
+		fclose(f);
+		CapeFormatter formatter(stdout);
+		if (print) formatter.Print(CapeEepromView(image), CAPE_PRINT_TEXT);
+		if (dump) formatter.Dump(image, sizeof(image));
+		return 0;
+	}
+	
+	// Production range as WWYY, same as serial number
+	size_t begin = 0, end = s.Count();
+	if (nArgs > 0) {
+		unsigned int first, last;
+		if (sscanf(args[0], "%4u", &first) != 1 || (nArgs > 1 && sscanf(args[1], "%4u", &last) != 1)) {
+			fprintf(stderr, "ERROR: Invalid production week, expected WWYY.\n");
+			return -1;
+		}
+		if (nArgs == 1) last = first;
+		s.FindProduction(first / 100, first % 100, last / 100, last % 100, begin, end);
+	}
+	uint8_t image[CAPE_EEPROM_SIZE];
+	for (size_t i = begin; i < end; i++) {
+		s.Extract(i, image);
+		CapeEepromView cape(image);
+		printf("%.*s  %6zu  %-16.*s %-4.*s  %.*s\n", SV(cape.GetSerialNumber()), s.GetBase(i), 
+			SV(cape.GetPartNumber()), SV(cape.GetVersion()), SV(cape.GetBoardName()));
+	}
+	printf("%zu boards listed, store has %zu boards, %zu base images\n", end - begin, s.Count(), s.BaseCount());
+	return 0;
+}
+
+// Server runs until killed, so its stats are written every STATS_INTERVAL
+// seconds and at SIGINT or SIGTERM, which are blocked in other threads
+static void ServeStats(sigset_t signals)
+{
+	struct timespec interval = {STATS_INTERVAL, 0};
+	for (;;) {
+		// Stats are reported at exit
+		if (sigtimedwait(&signals, NULL, &interval) > 0) exit(EXIT_SUCCESS);
+		if (statsPromFile) stats->WritePrometheus(statsPromFile);
+	}
+}
+
+// Loads all settings files once and serves images of them on Unix domain
+// socket, PROGRAM requests may write only devices. Returns only on error
+static int Serve(const char *socketPath, char **files, int nFiles, const char *cacheDir, bool sealed, 
+	const std::vector<const char*> &devices)
+{
+	CapeLoadOptions options;
+	if (cacheDir) options.cache = new SettingsCache(cacheDir, VERSION);
+	options.stats = stats;
+	
+	CapeServer server(options, sealed);
+	for (const char *device : devices) server.AllowDevice(device);
+	for (int i = 0; i < nFiles; i++) {
+		if (!std::ifstream(files[i]).good()) {
+			fprintf(stderr, "ERROR: Input file %s does not exist.\n", files[i]);
+			return -1;
+		}
+		if (server.Load(files[i]) < 0) return -1;
+	}
+	if (!server.Count()) {
+		fprintf(stderr, "ERROR: No input files to serve.\n");
+		return -1;
+	}
+	fprintf(stderr, "Serving %zu parts on %s\n", server.Count(), socketPath);
+	if (stats) {
+		sigset_t signals;
+		sigemptyset(&signals);
+		sigaddset(&signals, SIGINT);
+		sigaddset(&signals, SIGTERM);
+		pthread_sigmask(SIG_BLOCK, &signals, NULL);
+		std::thread(ServeStats, signals).detach();
+	}
+	return server.Run(socketPath);
+}
+
+// Reads all cape EEPROMs under root directory concurrently and prints
+// report. Returns number of EEPROMs without valid image.
+static int Scan(const char *root, unsigned int jobs, CapePrintFormat format)
+{
+	std::vector<std::string> nodes;
+	std::vector<ScanResult> results;
+	int failed = 0;
+	
+	FindEepromNodes(root, nodes);
+	ScanEeproms(nodes, jobs, results);
+	
+	CapeFormatter formatter(stdout);
+	if (format != CAPE_PRINT_TEXT) formatter.Header(format);
+	else printf("%-40s %-16s %-12s  %-16s %-4s  %s\n", "EEPROM", "STATUS", "SERIAL", "PART NUMBER", "VER", "NAME");
+	
+	for (size_t i = 0; i < results.size(); i++) {
+		const ScanResult &r = results[i];
+		CapeEepromView cape(r.image);
+		std::string status = ScanStatusName(r.status);
+		if (r.error) status = status + ": " + strerror(r.error);
+		
+		if (format != CAPE_PRINT_TEXT) {
+			formatter.Print(cape, format, i, r.path, status);
+		} else if (r.status == SCAN_OK || r.status == SCAN_UNKNOWN_REVISION) {
+			printf("%-40s %-16s %-12.*s  %-16.*s %-4.*s  %.*s\n", r.path.c_str(), status.c_str(), 
+				SV(cape.GetSerialNumber()), SV(cape.GetPartNumber()), SV(cape.GetVersion()), SV(cape.GetBoardName()));
+		} else {
+			printf("%-40s %s\n", r.path.c_str(), status.c_str());
+		}
+		if (r.status != SCAN_OK) failed++;
+	}
+	formatter.Flush();
+	
+	if (format == CAPE_PRINT_TEXT) 
+		printf("%zu EEPROMs, %zu valid, %d failed\n", results.size(), results.size() - failed, failed);
+	return failed;
+}
+
+// Programs all targets concurrently, each with its own board number 
+// starting from bn, and prints table of results. Returns number of
+// failed targets.
+static int GangProgram(const CapeEeprom &cape, unsigned int bn, char **targets, int nTargets, 
+	unsigned int pageSize, unsigned int jobs, bool sealed)
+{
+	struct GangResult {
+		ProgramResult r;
+		int ret;
+	};
+	std::vector<GangResult> results(nTargets);
+	
+	// Programming waits on devices, not CPU, so by default all targets are
+	// programmed at once and cycle time is that of slowest device
+	RunParallel(nTargets, jobs ? jobs : nTargets, [&](size_t i) {
+		CapeEeprom target(cape);
+		target.SetBoardNumber(bn + i);
+		results[i].ret = target.Program(targets[i], pageSize, &results[i].r, stats, sealed);
+	});
+	
+	int failed = 0;
+	printf("%-48s %-6s %-7s %s\n", "EEPROM", "BOARD", "PAGES", "RESULT");
+	for (int i = 0; i < nTargets; i++) {
+		const GangResult &g = results[i];
+		printf("%-48s %04u   %2d/%-2d   %s\n", targets[i], bn + i, g.r.pagesWritten, g.r.pagesTotal, 
+			g.ret == 0 ? "PASS" : "FAIL");
+		if (g.ret) failed++;
+	}
+	printf("%d targets, %d passed, %d failed\n", nTargets, nTargets - failed, failed);
+	return failed;
+}
+
+// Compiles all variants of settings file concurrently, each to file named
+// of its part number and version. Returns number of failed variants.
+static int BuildVariants(const char *fname, const std::vector<std::string> &variants, 
+	const CapeLoadOptions &options, bool nOpt, unsigned int bn, unsigned int jobs, 
+	bool print, bool dump, CapePrintFormat format, bool sealed)
+{
+	size_t n = variants.size();
+	std::vector<CapeEeprom> capes(n);
+	std::vector<std::string> outFiles(n);
+	std::vector<int> results(n, 0);
+	std::vector<std::vector<PinViolation>> violations(n);
+	
+	RunParallel(n, jobs, [&](size_t i) {
+		CapeLoadOptions o = options;
+		o.variant = variants[i].c_str();
+		o.violations = &violations[i];
+		capes[i] = CapeEeprom(fname, o);
+		if (nOpt) capes[i].SetBoardNumber(bn);
+	});
+	
+	// Violations are printed in order of variants, not as loads finish
+	for (size_t i = 0; i < n; i++) PrintPinViolations(stdout, violations[i], "variant " + variants[i]);
+	
+	// Nothing is written if any variant failed to load
+	for (size_t i = 0; i < n; i++) {
+		if (!capes[i].IsValid()) {
+			fprintf(stderr, "ERROR: Variant %s can not be built.\n", variants[i].c_str());
+			return n;
+		}
+	}
+	
+	// Output files must be distinct, checked before any is written
+	for (size_t i = 0; i < n; i++) {
+		char outFile[CAPE_FILE_NAME_MAX];
+		capes[i].FileName(outFile, sizeof(outFile), nOpt);
+		outFiles[i] = outFile;
+		for (size_t j = 0; j < i; j++) {
+			if (outFiles[i] == outFiles[j]) {
+				fprintf(stderr, "ERROR: Variants %s and %s have same output file %s.\n", 
+					variants[j].c_str(), variants[i].c_str(), outFiles[i].c_str());
+				return n;
+			}
+		}
+	}
+	
+	RunParallel(n, jobs, [&](size_t i) {
+		results[i] = capes[i].Write(outFiles[i].c_str(), options.stats, sealed);
+	});
+	
+	int failed = 0;
+	for (size_t i = 0; i < n; i++) {
+		fprintf(stderr, "Variant %-24s %s\n", variants[i].c_str(), outFiles[i].c_str());
+		if (results[i]) failed++;
+	}
+	fprintf(stderr, "%zu variants, %zu EEPROM files written.\n", n, n - failed);
+	
+	if (print || dump) {
+		CapeFormatter formatter(stdout);
+		if (print) formatter.Header(format);
+		for (size_t i = 0; i < n; i++) {
+			uint8_t image[CAPE_EEPROM_SIZE];
+			capes[i].Encode(image, sizeof(image));
+			if (print) formatter.Print(CapeEepromView(image), format, i, variants[i]);
+			if (dump) formatter.Dump(image, sizeof(image));
+		}
+	}
+	return failed;
+}
+
+// Streams manifest rows, each applied to copy of cape, into one packed
+// output of images, stdout if no output file. Memory use does not depend
+// on manifest size. Returns number of rows with errors.
+static int PackManifest(const CapeEeprom &cape, const char *manifest, const char *outFile, 
+	PackFormat format, bool sealed)
+{
+	FILE *in = strcmp(manifest, "-") == 0 ? stdin : fopen(manifest, "r");
+	if (!in) {
+		fprintf(stderr, "ERROR: Cannot open manifest %s: %s\n", manifest, strerror(errno));
+		return -1;
+	}
+	FILE *out = outFile ? fopen(outFile, "wb") : stdout;
+	if (!out) {
+		fprintf(stderr, "ERROR: Cannot create output file %s: %s\n", outFile, strerror(errno));
+		if (in != stdin) fclose(in);
+		return -1;
+	}
+	
+	ManifestReader reader(in, manifest);
+	ImagePacker packer(out, format);
+	ManifestRow row;
+	unsigned long rows = 0, images = 0, errors = 0;
+	if (reader.ReadHeader() < 0) errors++;
+	else while (reader.Next(row)) {
+		rows++;
+		CapeEeprom board(cape);
+		if (ApplyManifestRow(board, row, manifest) < 0) {
+			errors++;
+			continue;
+		}
+		uint8_t image[CAPE_SEALED_SIZE];
+		size_t size = sealed ? CAPE_SEALED_SIZE : CAPE_EEPROM_SIZE;
+		if (sealed) board.EncodeSealed(image, size);
+		else board.Encode(image, size);
+		char name[CAPE_FILE_NAME_MAX];
+		board.FileName(name, sizeof(name), true);
+		packer.Add(name, image, size);
+		images++;
+	}
+	errors += reader.ErrorCount();
+	if (packer.Finish() < 0) {
+		fprintf(stderr, "ERROR: Cannot write %s\n", outFile ? outFile : "standard output");
+		errors++;
+	}
+	if (in != stdin) fclose(in);
+	if (out != stdout) fclose(out);
+	fprintf(stderr, "%lu manifest rows, %lu images packed, %lu errors\n", rows, images, errors);
+	return errors;
+}
+
 int main (int argc, char *argv[])
 {
-    bool print = false, dump = false, nOpt = false;
-    int opt;
-	unsigned int bn;
+    bool print = false, dump = false, nOpt = false, archive = false, gang = false, validate = false;
+	bool sealed = false, verify = false, noWait = false;
+	unsigned int diffFlags = 0;
+	const char *scanRoot = NULL;
+    int opt, n;
+	unsigned int bn, bnLast, count = 0, pageSize = EEPROM_PAGE_SIZE, jobs = 0;
+	const char *device = NULL, *allocDb = NULL, *cacheDir = NULL, *variant = NULL, *golden = NULL;
+	const char *store = NULL, *socketPath = NULL, *stationDevice = NULL, *manifest = NULL;
+	std::vector<const char*> serveDevices;
+	PackFormat packFormat = PACK_ARCHIVE;
+	int storeCmd = 0;
+	CapePrintFormat format = CAPE_PRINT_TEXT;
 
-    while ((opt = getopt(argc, argv, "pdn:")) != -1) {
+    while ((opt = getopt_long(argc, argv, "pdan:c:f:", long_options, NULL)) != -1) {
         switch (opt) {
         case 'p': print = true; break;
         case 'd': dump = true; break;
-		case 'n': nOpt = (sscanf(optarg, "%04d \n", &bn) == 1); break;
+        case 'a': archive = true; break;
+		case 'f':
+			n = CapePrintFormatFromName(optarg);
+			if (n < 0) {
+				fprintf(stderr, "ERROR: Unknown print format: %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			format = (CapePrintFormat)n;
+			break;
+		case 'n':
+			// Single board number "N" or board number range "N-M"
+			n = sscanf(optarg, "%u-%u", &bn, &bnLast);
+			nOpt = (n >= 1);
+			if (n == 1) bnLast = bn;
+			break;
+		case 'c': 
+			if (sscanf(optarg, "%u", &count) != 1 || count == 0) {
+				fprintf(stderr, "ERROR: Invalid board count: %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'P': device = optarg; break;
+		case 'G': gang = true; break;
+		case 'A': allocDb = optarg; break;
+		case 'C': cacheDir = optarg; break;
+		case 'V': variant = optarg; break;
+		case 'L': validate = true; break;
+		case 'D': golden = optarg; break;
+		case 'I': diffFlags |= IMAGE_DIFF_IGNORE_SERIAL; break;
+		case 'T': case 'E': case 'W': store = optarg; storeCmd = opt; break;
+		case 'R': socketPath = optarg; break;
+		case 'U': serveDevices.push_back(optarg); break;
+		case 'K': sealed = true; break;
+		case 'Y': verify = true; break;
+		case 'B': stationDevice = optarg; break;
+		case 'Z': noWait = true; break;
+		case 'F': manifest = optarg; break;
+		case 'k':
+			n = PackFormatFromName(optarg);
+			if (n < 0) {
+				fprintf(stderr, "ERROR: Unknown pack format: %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			packFormat = (PackFormat)n;
+			break;
+		case 'M': statsSummary = true; break;
+		case 'X': statsPromFile = optarg; break;
+		case 's': scanRoot = optarg ? optarg : SCAN_DEFAULT_ROOT; break;
+		case 'j':
+			if (sscanf(optarg, "%u", &jobs) != 1) {
+				fprintf(stderr, "ERROR: Invalid number of jobs: %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'S':
+			if (sscanf(optarg, "%u", &pageSize) != 1 || pageSize == 0) {
+				fprintf(stderr, "ERROR: Invalid page size: %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
         default:
-            fprintf(stderr, "Usage: %s [-pd] [-nboard number] [input file] [output file]\n", argv[0]);
+            fprintf(stderr, USAGE, argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
             exit(EXIT_FAILURE);
         }
     }
 	
-	int fnArgCount = 0, i = 1;
+	if (statsSummary || statsPromFile) {
+		stats = new CapeStats();
+		atexit(ReportStats);
+	}
+	
+	if (scanRoot) {
+		PrintBanner();
+		exit(Scan(scanRoot, jobs, format) ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	
+	if (store) {
+		PrintBanner();
+		exit(StoreCommand(storeCmd, store, argv + optind, argc - optind, print, dump) ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	
+	if (verify) {
+		PrintBanner();
+		exit(VerifyImages(argv + optind, argc - optind, jobs) ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	
+	if (socketPath) {
+		PrintBanner();
+		exit(Serve(socketPath, argv + optind, argc - optind, cacheDir, sealed, serveDevices) ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	
+	// getopt permutes arguments, file names are left after options
+	int fnArgCount = 0, i = optind;
 	char *fnArg[2];
 	while (fnArgCount < 2 && i < argc) {
 		if (argv[i][0] != '-') {
@@ -58,48 +689,186 @@ int main (int argc, char *argv[])
 		i++;
 	}
 	if (!fnArgCount) {
-        fprintf(stderr, "Usage: %s [-pd] [-nboard number] [input file] [output file]\n", argv[0]);
+        fprintf(stderr, USAGE, argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
         exit(EXIT_FAILURE);
 	}
 	
-	fprintf (stderr, 
-		"\n******************************************************************************\n"
-		"BeagleBone Cape EEPROM Generator Ver:" VERSION "\n"
-		"(c) 2017, Milan Neskovic\n"
-		"License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>\n"
-		"This is free software: you are free to change and redistribute it.\n"
-		"There is NO WARRANTY, to the extent permitted by law.\n"
-		"******************************************************************************\n\n");
+	PrintBanner();
 
 	if (!std::ifstream(fnArg[0]).good()) {
 		fprintf(stderr, "ERROR: Specified input settings file does not exist.\n");
         exit(EXIT_FAILURE);
 	}
 	
+	if (golden) {
+		// All arguments are image files compared with golden image, its
+		// serial number must not be made up unless serial is ignored
+		CapeLoadOptions goldenOptions;
+		goldenOptions.requireSerialNumber = !(diffFlags & IMAGE_DIFF_IGNORE_SERIAL);
+		CapeEeprom goldenCape(golden, goldenOptions);
+		if (!goldenCape.IsValid()) {
+			fprintf(stderr, "ERROR: Golden file %s can not be loaded.\n", golden);
+			exit(EXIT_FAILURE);
+		}
+		exit(DiffImages(goldenCape, argv + optind, argc - optind, diffFlags, jobs) ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	
+	if (validate) {
+		exit(ValidateImages(fnArg[0], jobs) ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	
+	if (archive) {
+		exit(ListImages(fnArg[0], print, dump, format) ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	
+	// Board numbers missing in settings file are taken from shared allocator
+	CapeLoadOptions options;
+	if (allocDb && manifest) {
+		fprintf(stderr, "ERROR: --alloc-db can not be used with --manifest, board numbers are taken from manifest.\n");
+		exit(EXIT_FAILURE);
+	}
+	if (allocDb && nOpt) {
+		fprintf(stderr, "ERROR: --alloc-db can not be used with -n, board numbers are taken from allocator.\n");
+		exit(EXIT_FAILURE);
+	}
+	if (allocDb) options.allocator = new BoardNumberAllocator(allocDb);
+	// Gang and batch images are made for range of boards, all of it is
+	// reserved at once
+	if (gang && argc - optind > 1) options.boardCount = argc - optind - 1;
+	else if (count && !stationDevice) options.boardCount = count;
+	if (cacheDir) options.cache = new SettingsCache(cacheDir, VERSION);
+	
+	options.variant = variant;
+	options.stats = stats;
+	
+	// Settings file with variant blocks makes all variants, unless one is selected
+	std::vector<std::string> variants;
+	if (!variant && std::string(fnArg[0]).find(".txt") != std::string::npos) 
+		CapeEeprom::ListVariants(fnArg[0], variants);
+	if (!variants.empty() && (gang || device || stationDevice || manifest || count || fnArgCount > 1 || (nOpt && bnLast != bn))) {
+		fprintf(stderr, "ERROR: Settings file has variants, select one with --variant.\n");
+		exit(EXIT_FAILURE);
+	}
+	
 	// Load EEPROM data from file
-	CapeEeprom cape(fnArg[0]);
+	CapeEeprom cape;
+	int failed = 0;
+	if (variants.empty()) {
+		cape = CapeEeprom(fnArg[0], options);
+		if (!cape.IsValid()) {
+			delete options.allocator;
+			exit(EXIT_FAILURE);
+		}
+	}
+	else failed = BuildVariants(fnArg[0], variants, options, nOpt, bn, jobs, print, dump, format, sealed);
+	
+	if (stationDevice && variants.empty()) {
+		// Board numbers after first are allocated while station runs
+		StationOptions so;
+		so.device = stationDevice;
+		so.pageSize = pageSize;
+		so.count = count;
+		so.allocator = options.allocator;
+		so.sealed = sealed;
+		so.trigger = noWait ? NULL : stdin;
+		so.stats = stats;
+		if (nOpt) cape.SetBoardNumber(bn);
+		failed = RunStation(cape, so);
+	}
+	
+	// Return unused reserved board numbers
+	delete options.allocator;
+	if (options.cache) {
+		fprintf(stderr, "Settings cache: %lu hits, %lu misses\n", options.cache->Hits(), options.cache->Misses());
+		delete options.cache;
+	}
+	
+	if (!variants.empty() || stationDevice) exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+	
+	if (manifest) {
+		exit(PackManifest(cape, manifest, fnArgCount > 1 ? fnArg[1] : NULL, packFormat, sealed) ? 
+			EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	
+	if (gang) {
+		// All arguments after input file are target EEPROM devices
+		int nTargets = argc - optind - 1;
+		if (nTargets < 1) {
+			fprintf(stderr, "ERROR: No target EEPROM devices specified.\n");
+			exit(EXIT_FAILURE);
+		}
+		if (!nOpt) bn = atoi(std::string(cape.GetBoardNumber()).c_str());
+		if (bn + nTargets - 1 > MAX_BOARD_NUMBER) {
+			fprintf(stderr, "ERROR: Invalid board number range %u-%u.\n", bn, bn + nTargets - 1);
+			exit(EXIT_FAILURE);
+		}
+		exit(GangProgram(cape, bn, argv + optind + 1, nTargets, pageSize, jobs, sealed) ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	
+	if (count) {
+		// Batch of count boards, starting from -n board number if specified,
+		// otherwise from the board number in input file
+		if (!nOpt) bn = atoi(std::string(cape.GetBoardNumber()).c_str());
+		bnLast = bn + count - 1;
+		nOpt = true;
+	}
+	
+	if (nOpt && (bnLast < bn || bnLast > MAX_BOARD_NUMBER)) {
+		fprintf(stderr, "ERROR: Invalid board number range %u-%u.\n", bn, bnLast);
+        exit(EXIT_FAILURE);
+	}
+	
+	bool batch = nOpt && bnLast > bn;
+	
+	if (batch && device) {
+		fprintf(stderr, "ERROR: EEPROM can not be programmed with board number range.\n");
+        exit(EXIT_FAILURE);
+	}
 	
 	if (nOpt) cape.SetBoardNumber(bn);
 
 	// If settings file entered as input argument,
 	// write compiled binary EEPROM data to output file
-	if (std::string(fnArg[0]).find(".txt") != std::string::npos) {
+	if (std::string(fnArg[0]).find(".txt") != std::string::npos && batch) {
+		if (fnArgCount > 1) {
+			fprintf(stderr, "ERROR: Output file name can not be used with board number range.\n");
+			exit(EXIT_FAILURE);
+		}
+		// Settings are parsed once, each board image differs only in serial
+		// board number, so patch it and write image per board number
+		char outFile[CAPE_FILE_NAME_MAX];
+		for (unsigned int b = bn; b <= bnLast; b++) {
+			cape.SetBoardNumber(b);
+			cape.FileName(outFile, sizeof(outFile), true);
+			cape.Write(outFile, stats, sealed);
+		}
+		fprintf(stderr, "%u EEPROM files written.\n", bnLast - bn + 1);
+		// Leave first board of batch for print and dump
+		cape.SetBoardNumber(bn);
+	} else if (std::string(fnArg[0]).find(".txt") != std::string::npos && (fnArgCount > 1 || !device)) {
 		if (fnArgCount > 1) {
 			// Use input argument file name for output file if specified
-			cape.Write(fnArg[1]);
+			cape.Write(fnArg[1], stats, sealed);
 		} else {
-			// If not specified make output file name from settings data
-			if (nOpt)
-				// Make output file name of board name plus version plus board number if specified
-				cape.Write((cape.GetPartNumber()+"-"+cape.GetVersion()+"-"+cape.GetBoardNumber()+".eep").c_str());
-			else 
-				// Make output file name of board name plus version 
-				cape.Write((cape.GetPartNumber()+"-"+cape.GetVersion()+".eep").c_str());
+			// If not specified make output file name of part number plus 
+			// version, plus board number if specified
+			char outFile[CAPE_FILE_NAME_MAX];
+			cape.FileName(outFile, sizeof(outFile), nOpt);
+			cape.Write(outFile, stats, sealed);
 		}
 	}
 
+	// Program EEPROM device directly, writing only changed pages
+	if (device) {
+		ProgramResult r;
+		int ret = cape.Program(device, pageSize, &r, stats, sealed);
+		fprintf(stderr, "EEPROM %s: %d of %d pages written, verify %s\n", device, 
+			r.pagesWritten, r.pagesTotal, r.verified ? "OK" : "FAILED");
+		if (ret) exit(EXIT_FAILURE);
+	}
+
 	// Print parsed data to screen
-	if (print) cape.Print();
+	if (print) cape.Print(format);
 
 	// Dump parsed data to screen
 	if (dump) cape.Dump(); 
@@ -0,0 +1,82 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "eeprom_device.h"
+#include "eeprom_sim.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// EEPROM node of at24 driver or regular file
+class FileEepromDevice : public EepromDevice
+{
+public:
+	FileEepromDevice(int fd) : fd(fd) {}
+	~FileEepromDevice() { close(fd); }
+	ssize_t Read(uint8_t *buffer, size_t size, off_t offset);
+	int Write(const uint8_t *buffer, size_t size, off_t offset);
+private:
+	int fd;
+};
+
+ssize_t FileEepromDevice::Read(uint8_t *buffer, size_t size, off_t offset)
+{
+	size_t done = 0;
+	while (done < size) {
+		ssize_t n = pread(fd, buffer + done, size - done, offset + done);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		if (n == 0) break;
+		done += n;
+	}
+	return done;
+}
+
+int FileEepromDevice::Write(const uint8_t *buffer, size_t size, off_t offset)
+{
+	size_t done = 0;
+	while (done < size) {
+		ssize_t n = pwrite(fd, buffer + done, size - done, offset + done);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		// Device which takes no bytes, i.e. past end of EEPROM, would be
+		// retried forever
+		if (n == 0) {
+			errno = EIO;
+			return -1;
+		}
+		done += n;
+	}
+	return 0;
+}
+
+EepromDevice *EepromDevice::Open(const char *path)
+{
+	if (strncmp(path, EEPROM_SIM_PREFIX, strlen(EEPROM_SIM_PREFIX)) == 0) return OpenEepromSim(path);
+	
+	// Never created, mistyped EEPROM node must not become programmed file
+	int fd = open(path, O_RDWR);
+	return fd < 0 ? NULL : new FileEepromDevice(fd);
+}
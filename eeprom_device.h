@@ -0,0 +1,46 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EEPROM_DEVICE_H
+#define EEPROM_DEVICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Prefix of simulated EEPROM device paths, see eeprom_sim.h
+#define EEPROM_SIM_PREFIX	"sim:"
+
+// EEPROM device opened for reading and writing. Path is EEPROM node
+// (i.e. /sys/bus/i2c/devices/2-0057/eeprom), existing regular file, or
+// simulated device "sim:...". Functions return -1 and set errno on error.
+class EepromDevice
+{
+public:
+	// Returns NULL and sets errno on error
+	static EepromDevice *Open(const char *path);
+	virtual ~EepromDevice() {}
+	// Reads up to size bytes from offset, returns number of bytes read
+	virtual ssize_t Read(uint8_t *buffer, size_t size, off_t offset) = 0;
+	// Writes all size bytes at offset, returns 0
+	virtual int Write(const uint8_t *buffer, size_t size, off_t offset) = 0;
+};
+
+#endif
@@ -0,0 +1,96 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "eeprom_programmer.h"
+#include "eeprom_device.h"
+#include "cape_stats.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <memory>
+#include <vector>
+
+// Writes pages of image which differ from current device content, n bytes
+// of current content were read. Returns 0 on success, -1 on error.
+static int WritePages(EepromDevice &dev, const char *device, const uint8_t *image, const uint8_t *current, 
+	size_t size, ssize_t n, size_t pageSize, ProgramResult &r)
+{
+	for (size_t ofs = 0; ofs < size; ofs += pageSize) {
+		size_t len = ofs + pageSize > size ? size - ofs : pageSize;
+		r.pagesTotal++;
+		if (ofs + len <= (size_t)n && memcmp(current + ofs, image + ofs, len) == 0)
+			continue;
+		if (dev.Write(image + ofs, len, ofs) < 0) {
+			fprintf(stderr, "Cannot write EEPROM device: %s at 0x%04zx (%s)\n", device, ofs, strerror(errno));
+			return -1;
+		}
+		r.pagesWritten++;
+		r.bytesWritten += len;
+	}
+	return 0;
+}
+
+int ProgramEeprom(const char *device, const uint8_t *image, size_t size, size_t pageSize, ProgramResult *result, 
+	CapeStats *stats)
+{
+	ProgramResult r = {0, 0, 0, false};
+	std::vector<uint8_t> current(size);
+	
+	if (pageSize == 0) pageSize = EEPROM_PAGE_SIZE;
+	if (result) *result = r;
+	
+	std::unique_ptr<EepromDevice> dev(EepromDevice::Open(device));
+	if (!dev) {
+		fprintf(stderr, "Cannot open EEPROM device: %s (%s)\n", device, strerror(errno));
+		return -1;
+	}
+	
+	int ret;
+	{
+		CapeStatTimer timer(stats, STAT_PROGRAM);
+		// Bytes past end of short device file are treated as different
+		ssize_t n = dev->Read(current.data(), size, 0);
+		if (n < 0) {
+			fprintf(stderr, "Cannot read EEPROM device: %s (%s)\n", device, strerror(errno));
+			return -1;
+		}
+		ret = WritePages(*dev, device, image, current.data(), size, n, pageSize, r);
+	}
+	if (stats) stats->Count(STAT_BYTES_WRITTEN, r.bytesWritten);
+	if (ret < 0) {
+		if (result) *result = r;
+		return -1;
+	}
+	
+	// Read back and verify
+	{
+		CapeStatTimer timer(stats, STAT_VERIFY);
+		ssize_t n = dev->Read(current.data(), size, 0);
+		r.verified = (n == (ssize_t)size && memcmp(current.data(), image, size) == 0);
+	}
+	dev.reset();
+	
+	if (result) *result = r;
+	if (!r.verified) {
+		fprintf(stderr, "EEPROM verify failed: %s\n", device);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,48 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EEPROM_PROGRAMMER_H
+#define EEPROM_PROGRAMMER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Write page size of cape ID EEPROM (24LC32A / CAT24C256)
+#define EEPROM_PAGE_SIZE	32
+
+class CapeStats;
+
+struct ProgramResult {
+	int pagesTotal;
+	int pagesWritten;
+	int bytesWritten;
+	bool verified;
+};
+
+// Programs image to EEPROM device file (i.e. /sys/bus/i2c/devices/2-0057/eeprom,
+// existing regular file or simulated device "sim:...", see eeprom_sim.h).
+// Current device content is read first and only pages which differ are
+// written, each with one page aligned write. Written data is read back and
+// verified. Times of programming and verify and written bytes are added to
+// stats if not NULL. Returns 0 on success, -1 on error.
+int ProgramEeprom(const char *device, const uint8_t *image, size_t size, size_t pageSize, ProgramResult *result, 
+	CapeStats *stats = NULL);
+
+#endif
@@ -0,0 +1,142 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "eeprom_scanner.h"
+#include "worker_pool.h"
+#include "cape_crc.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+// Header revision written by settings parser
+static const uint8_t cape_rev[CAPE_REV_LEN] = {'A', '1'};
+
+const char *ScanStatusName(ScanStatus status)
+{
+	switch (status) {
+	case SCAN_OK: return "ok";
+	case SCAN_READ_ERROR: return "read error";
+	case SCAN_SHORT_READ: return "short read";
+	case SCAN_BLANK: return "blank";
+	case SCAN_INVALID_HEADER: return "invalid header";
+	case SCAN_UNKNOWN_REVISION: return "unknown revision";
+	case SCAN_BAD_CHECKSUM: return "bad checksum";
+	}
+	return "unknown";
+}
+
+struct Node {
+	std::string path;
+	dev_t dev;
+	ino_t ino;
+};
+
+static void FindNodes(const std::string &dir, std::vector<Node> &nodes, int depth)
+{
+	DIR *d = opendir(dir.c_str());
+	if (!d) return;
+	
+	struct dirent *e;
+	while ((e = readdir(d)) != NULL) {
+		if (e->d_name[0] == '.') continue;
+		std::string path = dir + "/" + e->d_name;
+		struct stat st;
+		// Follow symbolic links, sysfs devices are links to device directories
+		if (stat(path.c_str(), &st) < 0) continue;
+		if (S_ISDIR(st.st_mode)) {
+			if (depth > 1) FindNodes(path, nodes, depth - 1);
+		} else if (strcmp(e->d_name, "eeprom") == 0) {
+			nodes.push_back({path, st.st_dev, st.st_ino});
+		}
+	}
+	closedir(d);
+}
+
+void FindEepromNodes(const char *root, std::vector<std::string> &nodes, int maxDepth)
+{
+	// sysfs adapter directories i2c-N link to same devices as bus device
+	// directory, so same file is found more than once
+	std::vector<Node> found;
+	FindNodes(root, found, maxDepth);
+	std::sort(found.begin(), found.end(), [](const Node &a, const Node &b) {
+		if (a.dev != b.dev) return a.dev < b.dev;
+		if (a.ino != b.ino) return a.ino < b.ino;
+		if (a.path.size() != b.path.size()) return a.path.size() < b.path.size();
+		return a.path < b.path;
+	});
+	for (size_t i = 0; i < found.size(); i++) {
+		if (i == 0 || found[i].dev != found[i - 1].dev || found[i].ino != found[i - 1].ino) 
+			nodes.push_back(found[i].path);
+	}
+	std::sort(nodes.begin(), nodes.end());
+}
+
+static void ScanNode(ScanResult &r)
+{
+	memset(r.image, 0, sizeof(r.image));
+	r.error = 0;
+	
+	int fd = open(r.path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		r.status = SCAN_READ_ERROR;
+		r.error = errno;
+		return;
+	}
+	// Image is read with integrity trailer, if any
+	uint8_t image[CAPE_SEALED_SIZE];
+	size_t done = 0;
+	while (done < sizeof(image)) {
+		ssize_t n = pread(fd, image + done, sizeof(image) - done, done);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) {
+			r.error = n < 0 ? errno : 0;
+			break;
+		}
+		done += n;
+	}
+	close(fd);
+	memcpy(r.image, image, done < sizeof(r.image) ? done : sizeof(r.image));
+	
+	if (r.error) {
+		r.status = SCAN_READ_ERROR;
+	} else if (done < sizeof(r.image)) {
+		r.status = SCAN_SHORT_READ;
+	} else if (memcmp(r.image + CAPE_MAGIC_OFS, cape_magic, CAPE_MAGIC_LEN) == 0) {
+		r.status = memcmp(r.image + CAPE_REV_OFS, cape_rev, CAPE_REV_LEN) == 0 ? SCAN_OK : SCAN_UNKNOWN_REVISION;
+		if (CheckCapeImageSeal(image, done) == CAPE_SEAL_BAD) r.status = SCAN_BAD_CHECKSUM;
+	} else {
+		size_t i = 0;
+		while (i < sizeof(r.image) && r.image[i] == 0xFF) i++;
+		r.status = i == sizeof(r.image) ? SCAN_BLANK : SCAN_INVALID_HEADER;
+	}
+}
+
+void ScanEeproms(const std::vector<std::string> &nodes, unsigned int jobs, std::vector<ScanResult> &results)
+{
+	results.resize(nodes.size());
+	RunParallel(nodes.size(), jobs ? jobs : SCAN_DEFAULT_JOBS, [&](size_t i) {
+		results[i].path = nodes[i];
+		ScanNode(results[i]);
+	});
+}
@@ -0,0 +1,61 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EEPROM_SCANNER_H
+#define EEPROM_SCANNER_H
+
+#include <string>
+#include <vector>
+#include "cape_eeprom_layout.h"
+
+#define SCAN_DEFAULT_ROOT	"/sys/bus/i2c/devices"
+#define SCAN_MAX_DEPTH		3
+#define SCAN_DEFAULT_JOBS	16
+
+enum ScanStatus {
+	SCAN_OK,
+	SCAN_READ_ERROR,
+	SCAN_SHORT_READ,
+	SCAN_BLANK,				// erased EEPROM, all bytes 0xFF
+	SCAN_INVALID_HEADER,	// magic does not match
+	SCAN_UNKNOWN_REVISION,
+	SCAN_BAD_CHECKSUM		// integrity trailer does not match image
+};
+
+struct ScanResult {
+	std::string path;
+	ScanStatus status;
+	int error;				// errno of read error
+	uint8_t image[CAPE_EEPROM_SIZE];
+};
+
+const char *ScanStatusName(ScanStatus status);
+
+// Finds all files named eeprom under root directory, such as 
+// /sys/bus/i2c/devices/2-0054/eeprom, up to maxDepth directory levels.
+// Device reached by several paths (links) is listed once, by its shortest
+// path. Paths are sorted.
+void FindEepromNodes(const char *root, std::vector<std::string> &nodes, int maxDepth = SCAN_MAX_DEPTH);
+
+// Reads cape image from all nodes concurrently on up to jobs worker
+// threads and checks image header.
+void ScanEeproms(const std::vector<std::string> &nodes, unsigned int jobs, std::vector<ScanResult> &results);
+
+#endif
@@ -0,0 +1,188 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "eeprom_sim.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Address (2 bytes) and control byte of each transfer
+#define SIM_TRANSFER_OVERHEAD	3
+
+// Contents of "@name" devices, kept for life of process
+struct SimMemory {
+	std::mutex mutex;
+	std::vector<uint8_t> data;
+};
+
+static std::mutex sim_memories_mutex;
+static std::map<std::string, std::unique_ptr<SimMemory> > sim_memories;
+
+class SimEepromDevice : public EepromDevice
+{
+public:
+	SimEepromDevice(const EepromSimConfig &config, SimMemory *memory, int fd) : 
+		config(config), memory(memory), fd(fd), rng(config.seed) {}
+	~SimEepromDevice() { if (fd >= 0) close(fd); }
+	ssize_t Read(uint8_t *buffer, size_t size, off_t offset);
+	int Write(const uint8_t *buffer, size_t size, off_t offset);
+private:
+	// Sleeps for transfer of n bytes plus wait microseconds
+	void _Busy(size_t n, unsigned int wait);
+	int _Store(const uint8_t *buffer, size_t size, off_t offset);
+	
+	EepromSimConfig config;
+	SimMemory *memory;
+	int fd;
+	std::minstd_rand rng;
+};
+
+void SimEepromDevice::_Busy(size_t n, unsigned int wait)
+{
+	double us = (n + SIM_TRANSFER_OVERHEAD) * 9 * 1e6 / config.bus + wait;
+	std::this_thread::sleep_for(std::chrono::microseconds((long long)us));
+}
+
+ssize_t SimEepromDevice::Read(uint8_t *buffer, size_t size, off_t offset)
+{
+	if ((size_t)offset >= config.size) return 0;
+	if (offset + size > config.size) size = config.size - offset;
+	_Busy(size, 0);
+	if (memory) {
+		std::lock_guard<std::mutex> lock(memory->mutex);
+		memcpy(buffer, memory->data.data() + offset, size);
+		return size;
+	}
+	return pread(fd, buffer, size, offset) == (ssize_t)size ? (ssize_t)size : -1;
+}
+
+int SimEepromDevice::_Store(const uint8_t *buffer, size_t size, off_t offset)
+{
+	if (memory) {
+		std::lock_guard<std::mutex> lock(memory->mutex);
+		memcpy(memory->data.data() + offset, buffer, size);
+		return 0;
+	}
+	return pwrite(fd, buffer, size, offset) == (ssize_t)size ? 0 : -1;
+}
+
+int SimEepromDevice::Write(const uint8_t *buffer, size_t size, off_t offset)
+{
+	if (offset + size > config.size) {
+		errno = EFBIG;
+		return -1;
+	}
+	// Write is split at device page boundaries, as at24 driver does
+	std::uniform_real_distribution<double> failure(0, 1);
+	while (size > 0) {
+		size_t len = config.page - offset % config.page;
+		if (len > size) len = size;
+		if (config.fail > 0 && failure(rng) < config.fail) {
+			_Busy(len, 0);
+			errno = EIO;
+			return -1;
+		}
+		_Busy(len, config.twr);
+		if (_Store(buffer, len, offset) < 0) return -1;
+		buffer += len;
+		offset += len;
+		size -= len;
+	}
+	return 0;
+}
+
+int ParseEepromSimPath(const char *path, EepromSimConfig &config)
+{
+	size_t prefix = strlen(EEPROM_SIM_PREFIX);
+	if (strncmp(path, EEPROM_SIM_PREFIX, prefix) != 0) return -1;
+	
+	std::string spec(path + prefix);
+	size_t start = 0, end;
+	config = EepromSimConfig();
+	for (int i = 0; start <= spec.size(); i++, start = end + 1) {
+		end = spec.find(',', start);
+		if (end == std::string::npos) end = spec.size();
+		std::string item = spec.substr(start, end - start);
+		if (i == 0) {
+			config.backing = item;
+			continue;
+		}
+		size_t eq = item.find('=');
+		if (eq == std::string::npos) return -1;
+		std::string key = item.substr(0, eq);
+		const char *value = item.c_str() + eq + 1;
+		char *valueEnd;
+		double v = strtod(value, &valueEnd);
+		if (*value == '\0' || *valueEnd != '\0' || v < 0) return -1;
+		if (key == "size") config.size = v;
+		else if (key == "page") config.page = v;
+		else if (key == "twr") config.twr = v;
+		else if (key == "bus") config.bus = v;
+		else if (key == "fail") config.fail = v;
+		else if (key == "seed") config.seed = v;
+		else return -1;
+	}
+	if (config.backing.empty() || config.backing == "@" || config.size == 0 || config.page == 0 || config.bus == 0) return -1;
+	return 0;
+}
+
+EepromDevice *OpenEepromSim(const char *path)
+{
+	EepromSimConfig config;
+	if (ParseEepromSimPath(path, config) < 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	
+	if (config.backing[0] == '@') {
+		std::lock_guard<std::mutex> lock(sim_memories_mutex);
+		std::unique_ptr<SimMemory> &m = sim_memories[config.backing];
+		if (!m) m.reset(new SimMemory());
+		std::lock_guard<std::mutex> memoryLock(m->mutex);
+		if (m->data.size() < config.size) m->data.resize(config.size, 0xFF);
+		return new SimEepromDevice(config, m.get(), -1);
+	}
+	
+	// Erased device of configured size
+	int fd = open(config.backing.c_str(), O_RDWR | O_CREAT, 0644);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		if (fd >= 0) close(fd);
+		return NULL;
+	}
+	if ((size_t)st.st_size < config.size) {
+		std::vector<uint8_t> erased(config.size - st.st_size, 0xFF);
+		if (pwrite(fd, erased.data(), erased.size(), st.st_size) != (ssize_t)erased.size()) {
+			close(fd);
+			return NULL;
+		}
+	}
+	return new SimEepromDevice(config, NULL, fd);
+}
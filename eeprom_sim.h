@@ -0,0 +1,55 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EEPROM_SIM_H
+#define EEPROM_SIM_H
+
+#include <string>
+#include "eeprom_device.h"
+
+// Simulated I2C EEPROM (24LC32A by default), device path is 
+// "sim:backing[,option=value]...". Backing is file path, created erased
+// (0xFF) if shorter than device, or "@name" for device in memory, which
+// keeps its contents for life of process. Options:
+//   size=bytes		device size, default 4096
+//   page=bytes		device write page, writes are split at page boundaries
+//   twr=us			write cycle time of each page, default 5000
+//   bus=hz			I2C clock, default 100000; each byte is 9 clocks and 
+//					each transfer has 3 bytes of address and control
+//   fail=p			probability of page write failing with EIO, default 0
+//   seed=n			seed of write failures
+// Transfers and write cycles take simulated time in real time, so 
+// concurrent devices overlap as separate buses would.
+struct EepromSimConfig {
+	std::string backing;
+	size_t size = 4096;
+	size_t page = 32;
+	unsigned int twr = 5000;
+	unsigned int bus = 100000;
+	double fail = 0;
+	unsigned int seed = 1;
+};
+
+// Parses device path, returns -1 if it is not valid simulated device
+int ParseEepromSimPath(const char *path, EepromSimConfig &config);
+// Opens simulated device, returns NULL and sets errno on error
+EepromDevice *OpenEepromSim(const char *path);
+
+#endif
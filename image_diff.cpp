@@ -0,0 +1,147 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "image_diff.h"
+#include "cape_format.h"
+#include "worker_pool.h"
+#include <stdio.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+enum {
+	FIELD_HEX,
+	FIELD_ASCII,
+	FIELD_UINT16,
+	FIELD_PINS
+};
+
+struct ImageField {
+	const char *name;
+	int ofs;
+	int len;
+	int kind;
+};
+
+// Image fields named as settings file keywords
+static const ImageField image_fields[] = {
+	{"header",				CAPE_MAGIC_OFS,			CAPE_MAGIC_LEN,			FIELD_HEX},
+	{"eeprom_revision",		CAPE_REV_OFS,			CAPE_REV_LEN,			FIELD_ASCII},
+	{"board_name",			CAPE_BNAME_OFS,			CAPE_BNAME_LEN,			FIELD_ASCII},
+	{"version",				CAPE_VERSION_OFS,		CAPE_VERSION_LEN,		FIELD_ASCII},
+	{"manufacturer",		CAPE_MANUFACTURER_OFS,	CAPE_MANUFACTURER_LEN,	FIELD_ASCII},
+	{"part_number",			CAPE_PART_NUMBER_OFS,	CAPE_PART_NUMBER_LEN,	FIELD_ASCII},
+	{"number_of_pins",		CAPE_N_PINS_OFS,		2,						FIELD_UINT16},
+	{"serial",				CAPE_SERIAL_OFS,		CAPE_SERIAL_LEN,		FIELD_ASCII},
+	{"pins",				CAPE_PINS_OFS,			CAPE_PINS_LEN,			FIELD_PINS},
+	{"vdd_3V3b_current",	CAPE_VDD_3V3_OFS,		2,						FIELD_UINT16},
+	{"vdd_5v_current",		CAPE_VDD_5V_OFS,		2,						FIELD_UINT16},
+	{"sys_5v_current",		CAPE_SYS_5V_OFS,		2,						FIELD_UINT16},
+	{"dc_supplied",			CAPE_DC_OFS,			2,						FIELD_UINT16}
+};
+
+static std::string FieldText(const uint8_t *image, const ImageField &f)
+{
+	char text[64];
+	const uint8_t *p = image + f.ofs;
+	switch (f.kind) {
+	case FIELD_HEX:
+		for (int i = 0; i < f.len; i++) snprintf(text + i * 2, 3, "%02X", p[i]);
+		break;
+	case FIELD_ASCII:
+		snprintf(text, sizeof(text), "\"%.*s\"", (int)strnlen((const char*)p, f.len), p);
+		break;
+	default:
+		snprintf(text, sizeof(text), "%d", p[0] << 8 | p[1]);
+		break;
+	}
+	return text;
+}
+
+ImageDiff::ImageDiff(const uint8_t *golden, unsigned int flags) : flags(flags)
+{
+	memcpy(this->golden, golden, CAPE_EEPROM_SIZE);
+	memset(mask, 0xff, sizeof(mask));
+	if (flags & IMAGE_DIFF_IGNORE_SERIAL) memset(mask + CAPE_SERIAL_OFS, 0, CAPE_SERIAL_LEN);
+}
+
+bool ImageDiff::Equal(const uint8_t *image) const
+{
+	size_t i = 0;
+#if defined(__SSE2__)
+	__m128i acc = _mm_setzero_si128();
+	for (; i + 16 <= CAPE_EEPROM_SIZE; i += 16) {
+		__m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(image + i)), _mm_load_si128((const __m128i*)(golden + i)));
+		acc = _mm_or_si128(acc, _mm_and_si128(x, _mm_load_si128((const __m128i*)(mask + i))));
+	}
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xffff) return false;
+#else
+	uint64_t acc = 0;
+	for (; i + 8 <= CAPE_EEPROM_SIZE; i += 8) {
+		uint64_t a, g, m;
+		memcpy(&a, image + i, 8);
+		memcpy(&g, golden + i, 8);
+		memcpy(&m, mask + i, 8);
+		acc |= (a ^ g) & m;
+	}
+	if (acc) return false;
+#endif
+	uint8_t tail = 0;
+	for (; i < CAPE_EEPROM_SIZE; i++) tail |= (image[i] ^ golden[i]) & mask[i];
+	return tail == 0;
+}
+
+int ImageDiff::Diff(const uint8_t *image, std::vector<ImageFieldDiff> &diffs) const
+{
+	int n = 0;
+	for (const ImageField &f : image_fields) {
+		if (f.ofs == CAPE_SERIAL_OFS && (flags & IMAGE_DIFF_IGNORE_SERIAL)) continue;
+		if (memcmp(image + f.ofs, golden + f.ofs, f.len) == 0) continue;
+		
+		if (f.kind != FIELD_PINS) {
+			diffs.push_back(ImageFieldDiff{f.name, FieldText(golden, f), FieldText(image, f)});
+			n++;
+			continue;
+		}
+		for (size_t k = 0; k < BB_PIN_COUNT; k++) {
+			const uint8_t *a = image + f.ofs + k * 2, *g = golden + f.ofs + k * 2;
+			if (a[0] == g[0] && a[1] == g[1]) continue;
+			char name[16];
+			snprintf(name, sizeof(name), "pin P%d_%d", bb_pins[k][0], bb_pins[k][1]);
+			diffs.push_back(ImageFieldDiff{name, CapePinConfigText(g[0] << 8 | g[1]), CapePinConfigText(a[0] << 8 | a[1])});
+			n++;
+		}
+	}
+	return n;
+}
+
+void ImageDiff::FindMismatches(const CapeImageMap &images, unsigned int jobs, std::vector<size_t> &mismatches) const
+{
+	// Each chunk collects its own mismatches, merged in order
+	const size_t chunk = 4096;
+	size_t n = images.Count();
+	std::vector<std::vector<size_t> > found((n + chunk - 1) / chunk);
+	RunParallel(found.size(), jobs, [&](size_t c) {
+		for (size_t i = c * chunk; i < n && i < (c + 1) * chunk; i++) 
+			if (!Equal(images[i].Data())) found[c].push_back(i);
+	});
+	for (const std::vector<size_t> &f : found) mismatches.insert(mismatches.end(), f.begin(), f.end());
+}
@@ -0,0 +1,58 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGE_DIFF_H
+#define IMAGE_DIFF_H
+
+#include <string>
+#include <vector>
+#include "cape_eeprom_layout.h"
+#include "cape_eeprom_view.h"
+
+// Serial number field is not compared
+#define IMAGE_DIFF_IGNORE_SERIAL	0x01
+
+// Decoded difference of one field, pins are compared one by one
+struct ImageFieldDiff {
+	std::string field;
+	std::string expected;
+	std::string actual;
+};
+
+// Compares images against golden image. Whole images are compared 16 bytes
+// at a time (SSE2 where available) with ignored fields masked out, fields
+// are decoded only for images which differ.
+class ImageDiff
+{
+public:
+	ImageDiff(const uint8_t *golden, unsigned int flags = 0);
+	bool Equal(const uint8_t *image) const;
+	// Appends decoded differences, returns number of differing fields
+	int Diff(const uint8_t *image, std::vector<ImageFieldDiff> &diffs) const;
+	// Appends indexes of images which differ, images are compared in 
+	// parallel by jobs threads
+	void FindMismatches(const CapeImageMap &images, unsigned int jobs, std::vector<size_t> &mismatches) const;
+private:
+	alignas(16) uint8_t golden[CAPE_EEPROM_SIZE];
+	alignas(16) uint8_t mask[CAPE_EEPROM_SIZE];
+	unsigned int flags;
+};
+
+#endif
@@ -0,0 +1,367 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "image_store.h"
+#include "atomic_file.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+static uint32_t ReadLE32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void WriteLE32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+// Orders serial numbers WWYYAAAABBBB by year, week, assembly code and 
+// board number
+static int CompareSerial(const char *a, const char *b)
+{
+	int c = memcmp(a + 2, b + 2, 2);
+	if (!c) c = memcmp(a, b, 2);
+	if (!c) c = memcmp(a + 4, b + 4, CAPE_SERIAL_LEN - 4);
+	return c;
+}
+
+// Compares production year and week of serial number with key YYWW
+static int CompareProduction(const char *serial, const char *key)
+{
+	int c = memcmp(serial + 2, key, 2);
+	return c ? c : memcmp(serial, key + 2, 2);
+}
+
+// Reads whole images of log, torn image at end is ignored
+static void ReadLog(const std::string &logFile, std::vector<uint8_t> &images)
+{
+	int fd = open(logFile.c_str(), O_RDONLY);
+	if (fd < 0) return;
+	struct stat st;
+	if (fstat(fd, &st) == 0) {
+		images.resize(st.st_size / CAPE_EEPROM_SIZE * CAPE_EEPROM_SIZE);
+		size_t done = 0;
+		while (done < images.size()) {
+			ssize_t n = pread(fd, &images[done], images.size() - done, done);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) break;
+			done += n;
+		}
+		images.resize(done / CAPE_EEPROM_SIZE * CAPE_EEPROM_SIZE);
+	}
+	close(fd);
+}
+
+CapeImageStore::CapeImageStore(const char *fname) : 
+	valid(false), data(NULL), size(0), baseCount(0), recordCount(0), count(0)
+{
+	// Log is read before store file, so image merged into store file 
+	// meanwhile is found in one of them
+	std::vector<uint8_t> logImages;
+	ReadLog(std::string(fname) + IMAGE_STORE_LOG_SUFFIX, logImages);
+	
+	struct stat st;
+	int fd = open(fname, O_RDONLY);
+	if (fd < 0) {
+		if (errno == ENOENT && !logImages.empty()) {
+			// Store which has only log
+			valid = true;
+			_MergeLog(logImages);
+			return;
+		}
+		fprintf(stderr, "Cannot open file: %s\n", fname);
+		return;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size < IMAGE_STORE_HEADER_SIZE) {
+		fprintf(stderr, "File is not image store: %s\n", fname);
+		close(fd);
+		return;
+	}
+	
+	size = st.st_size;
+	void *m = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (m == MAP_FAILED) {
+		fprintf(stderr, "Cannot map file: %s\n", fname);
+		size = 0;
+		return;
+	}
+	
+	const uint8_t *p = (const uint8_t*)m;
+	baseCount = ReadLE32(p + 8);
+	recordCount = ReadLE32(p + 12);
+	if (memcmp(p, IMAGE_STORE_MAGIC, 4) != 0 || ReadLE32(p + 4) != IMAGE_STORE_VERSION ||
+		size != IMAGE_STORE_HEADER_SIZE + baseCount * CAPE_EEPROM_SIZE + recordCount * IMAGE_STORE_RECORD_SIZE) {
+		fprintf(stderr, "File is not image store: %s\n", fname);
+		munmap(m, size);
+		size = baseCount = recordCount = 0;
+		return;
+	}
+	data = p;
+	count = recordCount;
+	valid = true;
+	_MergeLog(logImages);
+}
+
+CapeImageStore::~CapeImageStore()
+{
+	if (data) munmap((void*)data, size);
+}
+
+void CapeImageStore::_MergeLog(const std::vector<uint8_t> &images)
+{
+	size_t n = images.size() / CAPE_EEPROM_SIZE;
+	if (!n) return;
+	
+	// Log images share bases among themselves, matching store file bases
+	// would need index of all bases on every open
+	std::unordered_map<std::string, uint32_t> baseIndex;
+	std::vector<LogRecord> records;
+	for (size_t i = 0; i < n; i++) {
+		const uint8_t *image = &images[i * CAPE_EEPROM_SIZE];
+		if (memcmp(image + CAPE_MAGIC_OFS, cape_magic, CAPE_MAGIC_LEN) != 0) continue;
+		std::string base((const char*)image, CAPE_EEPROM_SIZE);
+		memset(&base[CAPE_SERIAL_OFS], 0, CAPE_SERIAL_LEN);
+		auto b = baseIndex.emplace(base, baseCount + logBases.size());
+		if (b.second) logBases.push_back(base);
+		
+		LogRecord r;
+		memcpy(r.serial, image + CAPE_SERIAL_OFS, CAPE_SERIAL_LEN);
+		r.base = b.first->second;
+		records.push_back(r);
+	}
+	
+	// Sort keeping order of equal serial numbers, last one of them wins
+	std::stable_sort(records.begin(), records.end(), [](const LogRecord &a, const LogRecord &b) {
+		return CompareSerial(a.serial, b.serial) < 0;
+	});
+	for (size_t i = 0; i < records.size(); i++) {
+		if (i + 1 < records.size() && CompareSerial(records[i].serial, records[i + 1].serial) == 0) continue;
+		log.push_back(records[i]);
+	}
+	
+	// Index of log record is number of store file records before it, less
+	// those replaced by earlier log records, plus earlier log records
+	logReplaced.assign(log.size() + 1, 0);
+	for (size_t k = 0; k < log.size(); k++) {
+		size_t lo = 0, hi = recordCount;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (CompareSerial((const char*)_Record(mid), log[k].serial) < 0) lo = mid + 1;
+			else hi = mid;
+		}
+		bool replaced = lo < recordCount && CompareSerial((const char*)_Record(lo), log[k].serial) == 0;
+		log[k].index = lo - logReplaced[k] + k;
+		logReplaced[k + 1] = logReplaced[k] + replaced;
+	}
+	count = recordCount - logReplaced[log.size()] + log.size();
+}
+
+const uint8_t *CapeImageStore::_Record(size_t i) const
+{
+	return data + IMAGE_STORE_HEADER_SIZE + baseCount * CAPE_EEPROM_SIZE + i * IMAGE_STORE_RECORD_SIZE;
+}
+
+const uint8_t *CapeImageStore::_Base(size_t base) const
+{
+	if (base < baseCount) return data + IMAGE_STORE_HEADER_SIZE + base * CAPE_EEPROM_SIZE;
+	return (const uint8_t*)logBases[base - baseCount].data();
+}
+
+const CapeImageStore::LogRecord *CapeImageStore::_Locate(size_t i, size_t &record) const
+{
+	auto l = std::lower_bound(log.begin(), log.end(), i, [](const LogRecord &r, size_t i) {
+		return r.index < i;
+	});
+	if (l != log.end() && l->index == i) return &*l;
+	size_t before = l - log.begin();
+	record = i - before + (before ? logReplaced[before] : 0);
+	return NULL;
+}
+
+std::string_view CapeImageStore::GetSerial(size_t i) const
+{
+	size_t r;
+	const LogRecord *l = _Locate(i, r);
+	return std::string_view(l ? l->serial : (const char*)_Record(r), CAPE_SERIAL_LEN);
+}
+
+size_t CapeImageStore::GetBase(size_t i) const
+{
+	size_t r;
+	const LogRecord *l = _Locate(i, r);
+	return l ? l->base : ReadLE32(_Record(r) + CAPE_SERIAL_LEN);
+}
+
+void CapeImageStore::Extract(size_t i, uint8_t *image) const
+{
+	size_t base = GetBase(i);
+	if (base >= BaseCount()) {
+		// Damaged record, returned image has invalid header
+		memset(image, 0, CAPE_EEPROM_SIZE);
+		return;
+	}
+	memcpy(image, _Base(base), CAPE_EEPROM_SIZE);
+	memcpy(image + CAPE_SERIAL_OFS, GetSerial(i).data(), CAPE_SERIAL_LEN);
+}
+
+long CapeImageStore::Find(std::string_view serial) const
+{
+	if (serial.size() != CAPE_SERIAL_LEN) return -1;
+	size_t lo = 0, hi = count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int c = CompareSerial(GetSerial(mid).data(), serial.data());
+		if (c == 0) return mid;
+		if (c < 0) lo = mid + 1;
+		else hi = mid;
+	}
+	return -1;
+}
+
+void CapeImageStore::FindProduction(int firstWeek, int firstYear, int lastWeek, int lastYear, size_t &begin, size_t &end) const
+{
+	char first[8], last[8];
+	snprintf(first, sizeof(first), "%02d%02d", firstYear % 100, firstWeek % 100);
+	snprintf(last, sizeof(last), "%02d%02d", lastYear % 100, lastWeek % 100);
+	
+	size_t lo = 0, hi = count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (CompareProduction(GetSerial(mid).data(), first) < 0) lo = mid + 1;
+		else hi = mid;
+	}
+	begin = lo;
+	hi = count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (CompareProduction(GetSerial(mid).data(), last) <= 0) lo = mid + 1;
+		else hi = mid;
+	}
+	end = lo;
+}
+
+// Writes all records to store file, equal bases of log and store file are
+// stored once and bases left without records are dropped
+int CapeImageStore::_Compact(const char *fname) const
+{
+	std::vector<uint32_t> remap(BaseCount(), UINT32_MAX);
+	std::vector<uint32_t> used;
+	std::unordered_map<std::string_view, uint32_t> baseIndex;
+	size_t records = 0;
+	for (size_t i = 0; i < count; i++) {
+		size_t b = GetBase(i);
+		if (b >= BaseCount()) continue;
+		if (remap[b] == UINT32_MAX) {
+			auto e = baseIndex.emplace(std::string_view((const char*)_Base(b), CAPE_EEPROM_SIZE), used.size());
+			if (e.second) used.push_back(b);
+			remap[b] = e.first->second;
+		}
+		records++;
+	}
+	
+	AtomicFile file(fname);
+	FILE *f = file.File();
+	if (f) {
+		uint8_t header[IMAGE_STORE_HEADER_SIZE];
+		memcpy(header, IMAGE_STORE_MAGIC, 4);
+		WriteLE32(header + 4, IMAGE_STORE_VERSION);
+		WriteLE32(header + 8, used.size());
+		WriteLE32(header + 12, records);
+		fwrite(header, sizeof(header), 1, f);
+		for (size_t i = 0; i < used.size(); i++) fwrite(_Base(used[i]), CAPE_EEPROM_SIZE, 1, f);
+		for (size_t i = 0; i < count; i++) {
+			size_t b = GetBase(i);
+			if (b >= BaseCount()) continue;
+			uint8_t record[IMAGE_STORE_RECORD_SIZE];
+			memcpy(record, GetSerial(i).data(), CAPE_SERIAL_LEN);
+			WriteLE32(record + CAPE_SERIAL_LEN, remap[b]);
+			fwrite(record, sizeof(record), 1, f);
+		}
+	}
+	return file.Commit();
+}
+
+int CapeImageStore::Append(const char *fname, const uint8_t * const *images, size_t n)
+{
+	FileLock lock(fname);
+	if (!lock.IsLocked()) return -1;
+	
+	std::vector<uint8_t> buffer;
+	int ret = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (memcmp(images[i] + CAPE_MAGIC_OFS, cape_magic, CAPE_MAGIC_LEN) != 0) {
+			fprintf(stderr, "Image %zu has invalid EEPROM header, not stored\n", i);
+			continue;
+		}
+		buffer.insert(buffer.end(), images[i], images[i] + CAPE_EEPROM_SIZE);
+		ret++;
+	}
+	
+	// Images are appended to log, torn image of interrupted append is
+	// dropped first
+	std::string logFile = std::string(fname) + IMAGE_STORE_LOG_SUFFIX;
+	int fd = open(logFile.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+	struct stat st;
+	bool ok = fd >= 0 && fstat(fd, &st) == 0;
+	off_t logSize = ok ? st.st_size / CAPE_EEPROM_SIZE * CAPE_EEPROM_SIZE : 0;
+	if (ok && logSize != st.st_size) ok = ftruncate(fd, logSize) == 0;
+	for (size_t done = 0; ok && done < buffer.size(); ) {
+		ssize_t w = write(fd, &buffer[done], buffer.size() - done);
+		if (w < 0 && errno == EINTR) continue;
+		ok = w > 0;
+		if (ok) done += w;
+	}
+	ok = ok && fdatasync(fd) == 0;
+	if (!ok) fprintf(stderr, "Cannot write image store log: %s (%s)\n", logFile.c_str(), strerror(errno));
+	if (fd >= 0) close(fd);
+	if (!ok) return -1;
+	if (logSize == 0) SyncDirectory(logFile.c_str());
+	logSize += buffer.size();
+	
+	// Log is kept short, so readers merge it with store file cheaply
+	bool exists = stat(fname, &st) == 0;
+	if (exists && logSize / CAPE_EEPROM_SIZE < IMAGE_STORE_LOG_MAX) return ret;
+	
+	CapeImageStore store(fname);
+	if (!store.IsOpen() || store._Compact(fname) < 0) {
+		fprintf(stderr, "Cannot merge log into image store: %s, images are kept in log\n", fname);
+		return ret;
+	}
+	fd = open(logFile.c_str(), O_WRONLY | O_TRUNC);
+	if (fd >= 0) {
+		fsync(fd);
+		close(fd);
+	}
+	return ret;
+}
@@ -0,0 +1,103 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGE_STORE_H
+#define IMAGE_STORE_H
+
+#include <stddef.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "cape_eeprom_layout.h"
+
+#define IMAGE_STORE_MAGIC		"CEST"
+#define IMAGE_STORE_VERSION		1
+#define IMAGE_STORE_HEADER_SIZE	16
+#define IMAGE_STORE_RECORD_SIZE	16
+#define IMAGE_STORE_LOG_SUFFIX	".log"
+// Log is merged into store file when it has this many images, so opening
+// store reads at most this many images besides mapping store file
+#define IMAGE_STORE_LOG_MAX		256
+
+// Store of images of shipped boards. Each distinct base image (image with 
+// zeroed serial number) is stored once, each board has record of its 
+// serial number and base image index. Records are sorted by year, week, 
+// assembly code and board number, so board is found by binary search and 
+// boards of production weeks are one range of records. File is mapped to
+// memory, integers are little endian:
+//   header:  "CEST", version, base count, record count (uint32 each)
+//   bases:   base count * 244 bytes
+//   records: record count * (serial[12], base index (uint32))
+// Appended images go to append-only log <store file>.log of whole images,
+// which is merged into store file when it has IMAGE_STORE_LOG_MAX images.
+// Store object sorts the few images of log and merges them with records of
+// store file, log image replaces record of same serial number. Bases of log
+// images are shared with store file bases only after merge.
+class CapeImageStore
+{
+public:
+	CapeImageStore(const char *fname);
+	~CapeImageStore();
+	bool IsOpen() const { return valid; }
+	size_t Count() const { return count; }
+	size_t BaseCount() const { return baseCount + logBases.size(); }
+	std::string_view GetSerial(size_t i) const;
+	size_t GetBase(size_t i) const;
+	// Copies image of record i to image
+	void Extract(size_t i, uint8_t *image) const;
+	// Index of record with serial number, -1 if none
+	long Find(std::string_view serial) const;
+	// Range [begin, end) of records produced from first to last week and 
+	// year inclusive
+	void FindProduction(int firstWeek, int firstYear, int lastWeek, int lastYear, size_t &begin, size_t &end) const;
+	
+	// Appends images to log of store under lock of <store file>.lock, and
+	// merges log into store file, replaced atomically, when log is large
+	// enough. Record of already stored serial number is replaced. Returns
+	// number of images appended, -1 on error.
+	static int Append(const char *fname, const uint8_t * const *images, size_t count);
+private:
+	CapeImageStore(const CapeImageStore&);
+	CapeImageStore& operator=(const CapeImageStore&);
+	// Log image, index is its index among all records
+	struct LogRecord {
+		char serial[CAPE_SERIAL_LEN];
+		uint32_t base;
+		size_t index;
+	};
+	const uint8_t *_Record(size_t i) const;
+	const uint8_t *_Base(size_t base) const;
+	// Log record of index i, or NULL and index of store file record
+	const LogRecord *_Locate(size_t i, size_t &record) const;
+	void _MergeLog(const std::vector<uint8_t> &images);
+	int _Compact(const char *fname) const;
+	
+	bool valid;
+	const uint8_t *data;
+	size_t size;
+	size_t baseCount;		// bases of store file
+	size_t recordCount;		// records of store file
+	size_t count;			// records of store file and log
+	std::vector<std::string> logBases;
+	std::vector<LogRecord> log;
+	std::vector<size_t> logReplaced;	// store file records replaced by log records before
+};
+
+#endif
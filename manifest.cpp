@@ -0,0 +1,304 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "manifest.h"
+#include "cape_eeprom_layout.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <charconv>
+
+#define SV(s)	(int)(s).size(), (s).data()
+#define TAR_BLOCK	512
+
+static const char * const column_names[MANIFEST_COLUMN_COUNT] = {
+	"board_number",
+	"assembly_code",
+	"week_of_production",
+	"year_of_production",
+	"board_name",
+	"part_number",
+	"version"
+};
+
+ManifestReader::ManifestReader(FILE *in, const char *name) : 
+	in(in), name(name), start(0), end(0), line(0), errors(0), fieldCount(0)
+{
+}
+
+bool ManifestReader::_Line(char *&text, size_t &length)
+{
+	bool skip = false;
+	for (;;) {
+		char *nl = (char*)memchr(buffer + start, '\n', end - start);
+		if (nl || (feof(in) && end > start)) {
+			// Last line may have no newline
+			char *lineEnd = nl ? nl : buffer + end;
+			text = buffer + start;
+			length = lineEnd - text;
+			start = nl ? nl + 1 - buffer : end;
+			if (skip) {
+				skip = false;
+				continue;
+			}
+			line++;
+			if (length && text[length - 1] == '\r') length--;
+			return true;
+		}
+		if (feof(in) || ferror(in)) return false;
+		
+		if (start == 0 && end == sizeof(buffer)) {
+			// Rest of too long line is skipped
+			if (!skip) {
+				line++;
+				fprintf(stderr, "%s:%lu: line longer than %d bytes\n", name, line, MANIFEST_MAX_LINE);
+				errors++;
+				skip = true;
+			}
+			start = end = 0;
+		}
+		memmove(buffer, buffer + start, end - start);
+		end -= start;
+		start = 0;
+		end += fread(buffer + end, 1, sizeof(buffer) - end, in);
+	}
+}
+
+int ManifestReader::_Split(char *text, size_t length, std::string_view *fields)
+{
+	char *p = text, *lineEnd = text + length;
+	int n = 0;
+	for (;;) {
+		if (n == MANIFEST_MAX_COLUMNS) return -1;
+		while (p < lineEnd && (*p == ' ' || *p == '\t')) p++;
+		char *value = p, *w = p;
+		if (p < lineEnd && *p == '"') {
+			// Quoted value is unescaped in place
+			value = w = ++p;
+			for (;;) {
+				if (p == lineEnd) return -1;
+				if (*p == '"' && (p + 1 == lineEnd || p[1] != '"')) break;
+				if (*p == '"') p++;
+				*w++ = *p++;
+			}
+			p++;
+			while (p < lineEnd && (*p == ' ' || *p == '\t')) p++;
+			if (p < lineEnd && *p != ',') return -1;
+		} else {
+			while (p < lineEnd && *p != ',') p++;
+			w = p;
+			while (w > value && (w[-1] == ' ' || w[-1] == '\t')) w--;
+		}
+		fields[n++] = std::string_view(value, w - value);
+		if (p == lineEnd) return n;
+		p++;
+	}
+}
+
+int ManifestReader::ReadHeader()
+{
+	char *text;
+	size_t length;
+	std::string_view fields[MANIFEST_MAX_COLUMNS];
+	
+	if (!_Line(text, length) || (fieldCount = _Split(text, length, fields)) < 0) {
+		fprintf(stderr, "%s: missing or invalid header line\n", name);
+		return -1;
+	}
+	bool boardNumber = false;
+	for (int i = 0; i < fieldCount; i++) {
+		columns[i] = -1;
+		for (int c = 0; c < MANIFEST_COLUMN_COUNT; c++) 
+			if (fields[i] == column_names[c]) columns[i] = c;
+		boardNumber |= columns[i] == MANIFEST_BOARD_NUMBER;
+	}
+	if (!boardNumber) {
+		fprintf(stderr, "%s: header has no board_number column\n", name);
+		return -1;
+	}
+	return 0;
+}
+
+bool ManifestReader::Next(ManifestRow &row)
+{
+	char *text;
+	size_t length;
+	std::string_view fields[MANIFEST_MAX_COLUMNS];
+	
+	while (_Line(text, length)) {
+		if (length == 0) continue;
+		int n = _Split(text, length, fields);
+		if (n < 0) {
+			fprintf(stderr, "%s:%lu: invalid CSV line\n", name, line);
+			errors++;
+			continue;
+		}
+		row.line = line;
+		for (int c = 0; c < MANIFEST_COLUMN_COUNT; c++) row.values[c] = std::string_view();
+		for (int i = 0; i < n && i < fieldCount; i++) 
+			if (columns[i] >= 0) row.values[columns[i]] = fields[i];
+		return true;
+	}
+	if (ferror(in)) {
+		fprintf(stderr, "%s: read error\n", name);
+		errors++;
+	}
+	return false;
+}
+
+// Parses decimal number in range min to max
+static bool ParseNumber(std::string_view v, int min, int max, int &value)
+{
+	int n;
+	std::from_chars_result r = std::from_chars(v.data(), v.data() + v.size(), n);
+	if (r.ec != std::errc() || r.ptr != v.data() + v.size() || n < min || n > max) return false;
+	value = n;
+	return true;
+}
+
+int ApplyManifestRow(CapeEeprom &cape, const ManifestRow &row, const char *name)
+{
+	// Serial number parts missing in row are kept, serial is WWYYAAAANNNN
+	std::string_view serial = cape.GetSerialNumber();
+	int week = 0, year = 0, bn = -1;
+	char current[5] = "0000";
+	if (serial.size() == CAPE_SERIAL_LEN) serial.substr(4, 4).copy(current, 4);
+	std::string_view asmCode = current;
+	ParseNumber(serial.substr(0, 2), 1, 53, week);
+	ParseNumber(serial.substr(2, 2), 0, 99, year);
+	
+	static const struct {
+		int column;
+		int min;
+		int max;
+		int *value;
+	} numbers[] = {
+		{MANIFEST_BOARD_NUMBER, 0, 9999, &bn},
+		{MANIFEST_WEEK_OF_PRODUCTION, 1, 53, &week},
+		{MANIFEST_YEAR_OF_PRODUCTION, 0, 99, &year}
+	};
+	int errors = 0;
+	for (const auto &n : numbers) {
+		std::string_view v = row.values[n.column];
+		if (v.empty() && n.column != MANIFEST_BOARD_NUMBER) continue;
+		if (!ParseNumber(v, n.min, n.max, *n.value)) {
+			fprintf(stderr, "%s:%lu: %s value \"%.*s\" is not number from %d to %d\n", name, row.line, 
+				column_names[n.column], SV(v), n.min, n.max);
+			errors++;
+		}
+	}
+	if (!row.values[MANIFEST_ASSEMBLY_CODE].empty()) asmCode = row.values[MANIFEST_ASSEMBLY_CODE];
+	if (asmCode.size() > 4) {
+		fprintf(stderr, "%s:%lu: assembly_code longer than 4 characters\n", name, row.line);
+		errors++;
+	}
+	if (errors) return -1;
+	
+	// Week or year of template serial number may be out of range too
+	if (cape.SetSerialNumber(week, year, asmCode, bn) < 0) {
+		fprintf(stderr, "%s:%lu: serial number of week %d, year %d, board number %d is not valid\n", name, row.line, 
+			week, year, bn);
+		errors++;
+	}
+	
+	static const struct {
+		int column;
+		int (CapeEeprom::*set)(std::string_view);
+	} strings[] = {
+		{MANIFEST_BOARD_NAME, &CapeEeprom::SetBoardName},
+		{MANIFEST_PART_NUMBER, &CapeEeprom::SetPartNumber},
+		{MANIFEST_VERSION, &CapeEeprom::SetVersion}
+	};
+	for (const auto &s : strings) {
+		std::string_view v = row.values[s.column];
+		if (!v.empty() && (cape.*s.set)(v) < 0) {
+			fprintf(stderr, "%s:%lu: %s \"%.*s\" too long\n", name, row.line, column_names[s.column], SV(v));
+			errors++;
+		}
+	}
+	return errors ? -1 : 0;
+}
+
+int PackFormatFromName(const char *name)
+{
+	if (strcmp(name, "archive") == 0) return PACK_ARCHIVE;
+	if (strcmp(name, "tar") == 0) return PACK_TAR;
+	return -1;
+}
+
+ImagePacker::ImagePacker(FILE *out, PackFormat format) : 
+	out(out), format(format), buffer(PACK_BUFFER_SIZE), used(0), failed(false), finished(false)
+{
+}
+
+ImagePacker::~ImagePacker()
+{
+	if (!finished) Finish();
+}
+
+void ImagePacker::_Flush()
+{
+	if (used && fwrite(buffer.data(), 1, used, out) != used) failed = true;
+	used = 0;
+}
+
+char *ImagePacker::_Reserve(size_t n)
+{
+	if (used + n > buffer.size()) _Flush();
+	char *p = buffer.data() + used;
+	used += n;
+	return p;
+}
+
+void ImagePacker::Add(const char *name, const uint8_t *image, size_t size)
+{
+	if (format == PACK_ARCHIVE) {
+		memcpy(_Reserve(size), image, size);
+		return;
+	}
+	
+	// ustar header, data padded to block size
+	size_t padded = (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+	char *h = _Reserve(TAR_BLOCK + padded);
+	memset(h, 0, TAR_BLOCK + padded);
+	strncpy(h, name, 99);
+	memcpy(h + 100, "0000644", 7);
+	memcpy(h + 108, "0000000", 7);
+	memcpy(h + 116, "0000000", 7);
+	snprintf(h + 124, 12, "%011o", (unsigned int)size);
+	snprintf(h + 136, 12, "%011lo", (unsigned long)time(NULL));
+	memset(h + 148, ' ', 8);
+	h[156] = '0';
+	memcpy(h + 257, "ustar", 6);
+	memcpy(h + 263, "00", 2);
+	unsigned int sum = 0;
+	for (int i = 0; i < TAR_BLOCK; i++) sum += (uint8_t)h[i];
+	snprintf(h + 148, 8, "%06o", sum);
+	memcpy(h + TAR_BLOCK, image, size);
+}
+
+int ImagePacker::Finish()
+{
+	if (format == PACK_TAR && !finished) memset(_Reserve(2 * TAR_BLOCK), 0, 2 * TAR_BLOCK);
+	finished = true;
+	_Flush();
+	if (fflush(out) != 0) failed = true;
+	return failed ? -1 : 0;
+}
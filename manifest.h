@@ -0,0 +1,116 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdio.h>
+#include <string_view>
+#include <vector>
+#include "cape_eeprom.h"
+
+#define MANIFEST_MAX_LINE		4096
+#define MANIFEST_MAX_COLUMNS	16
+#define PACK_BUFFER_SIZE		(1 << 20)
+
+// Manifest columns, named in header line as settings keywords
+enum ManifestColumn {
+	MANIFEST_BOARD_NUMBER,
+	MANIFEST_ASSEMBLY_CODE,
+	MANIFEST_WEEK_OF_PRODUCTION,
+	MANIFEST_YEAR_OF_PRODUCTION,
+	MANIFEST_BOARD_NAME,
+	MANIFEST_PART_NUMBER,
+	MANIFEST_VERSION,
+	MANIFEST_COLUMN_COUNT
+};
+
+// Values of one manifest row by column, empty if column is missing or 
+// value is empty. Values point into reader buffer until next row.
+struct ManifestRow {
+	unsigned long line;
+	std::string_view values[MANIFEST_COLUMN_COUNT];
+};
+
+// Reads CSV manifest row by row through fixed size buffer, so memory does
+// not depend on manifest size. First line is header naming columns, 
+// unknown columns are ignored. Values may be quoted, "" is quote in 
+// quoted value.
+class ManifestReader
+{
+public:
+	ManifestReader(FILE *in, const char *name);
+	// Returns -1 and prints error if header has no board_number column
+	int ReadHeader();
+	// Gets next row, returns false at end of manifest. Rows with errors
+	// are reported and skipped.
+	bool Next(ManifestRow &row);
+	unsigned long ErrorCount() const { return errors; }
+private:
+	// Next line without newline, false at end of file
+	bool _Line(char *&line, size_t &length);
+	// Splits line in place into fields, returns number of fields or -1
+	int _Split(char *line, size_t length, std::string_view *fields);
+	
+	FILE *in;
+	const char *name;
+	char buffer[MANIFEST_MAX_LINE];
+	size_t start, end;
+	unsigned long line;
+	unsigned long errors;
+	int columns[MANIFEST_MAX_COLUMNS];	// ManifestColumn of each field, -1 if ignored
+	int fieldCount;
+};
+
+enum PackFormat {
+	PACK_ARCHIVE,	// concatenated images, as readback archive
+	PACK_TAR		// tar entry per image named as output file of image
+};
+
+// Returns format for name archive or tar, -1 if unknown
+int PackFormatFromName(const char *name);
+
+// Writes images to one output stream through large buffer
+class ImagePacker
+{
+public:
+	ImagePacker(FILE *out, PackFormat format);
+	~ImagePacker();
+	// Adds image of size bytes named name
+	void Add(const char *name, const uint8_t *image, size_t size);
+	// Writes end of stream and flushes, returns -1 on write error
+	int Finish();
+private:
+	char *_Reserve(size_t n);
+	void _Flush();
+	
+	FILE *out;
+	PackFormat format;
+	std::vector<char> buffer;
+	size_t used;
+	bool failed;
+	bool finished;
+};
+
+// Applies values of manifest row to cape, returns -1 if any value is 
+// invalid, error is printed with manifest name and line
+int ApplyManifestRow(CapeEeprom &cape, const ManifestRow &row, const char *name);
+
+#endif
@@ -0,0 +1,67 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pin_validator.h"
+
+std::string PinSetNames(const PinSet &pins)
+{
+	std::string names;
+	char name[16];
+	for (size_t k = 0; k < BB_PIN_COUNT; k++) {
+		if (!pins.Test(k)) continue;
+		snprintf(name, sizeof(name), "%sP%d_%d", names.empty() ? "" : " ", bb_pins[k][0], bb_pins[k][1]);
+		names += name;
+	}
+	return names;
+}
+
+int ValidateCapeImage(const uint8_t *image, std::vector<PinViolation> *violations)
+{
+	if (!violations) return CheckPinRules(image, [](const PinRule &, const PinSet &, int) {});
+	
+	return CheckPinRules(image, [&](const PinRule &rule, const PinSet &pins, int value) {
+		char detail[64] = "";
+		switch (rule.kind) {
+		case PIN_RULE_PIN_COUNT:
+			snprintf(detail, sizeof(detail), " (%d pins configured, number_of_pins %d)", 
+				value, PinImageUint16(image, CAPE_N_PINS_OFS));
+			break;
+		case PIN_RULE_RAIL_CURRENT:
+			snprintf(detail, sizeof(detail), " (%d mA, limit %d mA)", value, rule.limit);
+			break;
+		default:
+			break;
+		}
+		std::string message = std::string(rule.description) + detail;
+		if (pins.Any()) message += ": " + PinSetNames(pins);
+		violations->push_back(PinViolation{&rule, message});
+	});
+}
+
+int PrintPinViolations(FILE *f, const std::vector<PinViolation> &violations, const std::string &source)
+{
+	int errors = 0;
+	for (const PinViolation &v : violations) {
+		fprintf(f, "%s%s%s: %s [%s]\n", source.c_str(), source.empty() ? "" : ": ", 
+			v.rule->level == PIN_RULE_ERROR ? "Error" : "Warning", v.message.c_str(), v.rule->name);
+		if (v.rule->level == PIN_RULE_ERROR) errors++;
+	}
+	return errors;
+}
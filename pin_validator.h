@@ -0,0 +1,188 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PIN_VALIDATOR_H
+#define PIN_VALIDATOR_H
+
+#include <stdio.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "cape_eeprom_layout.h"
+
+// Set of bb_pins slots, usable in constant expressions
+struct PinSet {
+	uint64_t w[2] = {0, 0};
+	
+	constexpr void Set(int k) { w[k >> 6] |= 1ULL << (k & 63); }
+	constexpr bool Test(int k) const { return (w[k >> 6] >> (k & 63)) & 1; }
+	constexpr bool Any() const { return (w[0] | w[1]) != 0; }
+	constexpr int Count() const { return __builtin_popcountll(w[0]) + __builtin_popcountll(w[1]); }
+	constexpr PinSet operator&(const PinSet &o) const { PinSet r; r.w[0] = w[0] & o.w[0]; r.w[1] = w[1] & o.w[1]; return r; }
+};
+
+// Index of pin in bb_pins for pin name as P8_3 or P9_12, throws on 
+// invalid name, which is compile error in constant expression
+constexpr int CapePinIndex(std::string_view pin) {
+	size_t i = 1;
+	int header = 0, n = 0;
+	if (pin.size() < 4 || (pin[0] != 'P' && pin[0] != 'p')) throw "invalid pin name";
+	for (; i < pin.size() && pin[i] >= '0' && pin[i] <= '9'; i++) header = header * 10 + pin[i] - '0';
+	if (i == 1 || i >= pin.size() || pin[i] != '_') throw "invalid pin name";
+	size_t first = ++i;
+	for (; i < pin.size() && pin[i] >= '0' && pin[i] <= '9'; i++) n = n * 10 + pin[i] - '0';
+	if (i == first || i != pin.size() || header < 8 || header > 9 || n >= 64) throw "invalid pin name";
+	int k = pin_order[(header-8)*64+n];
+	if (k < 0) throw "pin can not be used by cape";
+	return k;
+}
+
+// Pin set of space separated pin names
+constexpr PinSet MakePinSet(std::string_view names) {
+	PinSet set;
+	while (!names.empty()) {
+		size_t end = names.find(' ');
+		if (end != 0) set.Set(CapePinIndex(names.substr(0, end)));
+		names = end == std::string_view::npos ? std::string_view() : names.substr(end + 1);
+	}
+	return set;
+}
+
+enum PinRuleLevel {
+	PIN_RULE_WARNING,
+	PIN_RULE_ERROR
+};
+
+enum PinRuleKind {
+	PIN_RULE_RESERVED,		// pins used by base board
+	PIN_RULE_PIN_COUNT,		// number_of_pins less than used pins
+	PIN_RULE_UNUSED_CONFIG,	// configuration bits of pin not marked used
+	PIN_RULE_RAIL_CURRENT,	// current drawn from rail over limit
+	PIN_RULE_RAIL_SUPPLY	// VDD_5V both supplied and drawn
+};
+
+struct PinRule {
+	const char *name;
+	PinRuleKind kind;
+	PinRuleLevel level;
+	PinSet pins;			// PIN_RULE_RESERVED pins
+	int offset;				// PIN_RULE_RAIL_CURRENT field
+	int limit;				// PIN_RULE_RAIL_CURRENT maximum in mA
+	const char *description;
+};
+
+// Rules checked on every image. Reserved pins and rail limits are those
+// of BeagleBone Black, pins shared with on-board devices are warnings as
+// device can be disabled by base board device tree.
+static constexpr PinRule pin_rules[] = {
+	{"number_of_pins", PIN_RULE_PIN_COUNT, PIN_RULE_ERROR, {}, 0, 0, 
+		"more pins configured than number_of_pins"},
+	{"unused_config", PIN_RULE_UNUSED_CONFIG, PIN_RULE_WARNING, {}, 0, 0, 
+		"configuration of pins not marked used"},
+	{"emmc", PIN_RULE_RESERVED, PIN_RULE_WARNING, 
+		MakePinSet("P8_3 P8_4 P8_5 P8_6 P8_20 P8_21 P8_22 P8_23 P8_24 P8_25"), 0, 0, 
+		"pins shared with on-board eMMC"},
+	{"hdmi", PIN_RULE_RESERVED, PIN_RULE_WARNING, 
+		MakePinSet("P8_27 P8_28 P8_29 P8_30 P8_31 P8_32 P8_33 P8_34 P8_35 P8_36 P8_37 P8_38 "
+			"P8_39 P8_40 P8_41 P8_42 P8_43 P8_44 P8_45 P8_46"), 0, 0, 
+		"pins shared with on-board HDMI framer"},
+	{"hdmi_audio", PIN_RULE_RESERVED, PIN_RULE_WARNING, MakePinSet("P9_25 P9_28 P9_29 P9_31"), 0, 0, 
+		"pins shared with HDMI audio"},
+	{"cape_i2c", PIN_RULE_RESERVED, PIN_RULE_WARNING, MakePinSet("P9_19 P9_20"), 0, 0, 
+		"pins of I2C2 bus used to read cape EEPROMs"},
+	{"vdd_3v3b", PIN_RULE_RAIL_CURRENT, PIN_RULE_ERROR, {}, CAPE_VDD_3V3_OFS, 250, 
+		"VDD_3V3B current over limit"},
+	{"vdd_5v", PIN_RULE_RAIL_CURRENT, PIN_RULE_ERROR, {}, CAPE_VDD_5V_OFS, 1000, 
+		"VDD_5V current over limit"},
+	{"sys_5v", PIN_RULE_RAIL_CURRENT, PIN_RULE_ERROR, {}, CAPE_SYS_5V_OFS, 250, 
+		"SYS_5V current over limit"},
+	{"vdd_5v_supply", PIN_RULE_RAIL_SUPPLY, PIN_RULE_WARNING, {}, 0, 0, 
+		"VDD_5V both supplied and drawn by cape"}
+};
+
+constexpr int PinImageUint16(const uint8_t *image, int ofs) { return image[ofs] << 8 | image[ofs + 1]; }
+
+// Pins marked used in image
+constexpr PinSet UsedPins(const uint8_t *image) {
+	PinSet used;
+	for (size_t k = 0; k < BB_PIN_COUNT; k++) 
+		if (image[CAPE_PINS_OFS + k * 2] & (PIN_USED >> 8)) used.Set(k);
+	return used;
+}
+
+// Checks image against all pin rules, calls f(rule, pins, value) for each
+// violated rule, where pins are offending pins and value is offending pin
+// count or current. Returns number of violated error level rules.
+template <typename F>
+constexpr int CheckPinRules(const uint8_t *image, F &&f) {
+	PinSet used = UsedPins(image), stale;
+	for (size_t k = 0; k < BB_PIN_COUNT; k++) 
+		if (!used.Test(k) && PinImageUint16(image, CAPE_PINS_OFS + k * 2)) stale.Set(k);
+	
+	int errors = 0;
+	for (const PinRule &rule : pin_rules) {
+		PinSet pins;
+		int value = 0;
+		bool violated = false;
+		switch (rule.kind) {
+		case PIN_RULE_RESERVED:
+			pins = used & rule.pins;
+			violated = pins.Any();
+			break;
+		case PIN_RULE_PIN_COUNT:
+			value = used.Count();
+			violated = value > PinImageUint16(image, CAPE_N_PINS_OFS);
+			break;
+		case PIN_RULE_UNUSED_CONFIG:
+			pins = stale;
+			violated = pins.Any();
+			break;
+		case PIN_RULE_RAIL_CURRENT:
+			value = PinImageUint16(image, rule.offset);
+			violated = value > rule.limit;
+			break;
+		case PIN_RULE_RAIL_SUPPLY:
+			value = PinImageUint16(image, CAPE_VDD_5V_OFS);
+			violated = value && PinImageUint16(image, CAPE_DC_OFS);
+			break;
+		}
+		if (violated) {
+			if (rule.level == PIN_RULE_ERROR) errors++;
+			f(rule, pins, value);
+		}
+	}
+	return errors;
+}
+
+struct PinViolation {
+	const PinRule *rule;
+	std::string message;
+};
+
+// Validates image, returns number of errors. Violations with messages
+// are appended to violations if not NULL.
+int ValidateCapeImage(const uint8_t *image, std::vector<PinViolation> *violations = NULL);
+// Names of pins in set, space separated
+std::string PinSetNames(const PinSet &pins);
+// Prints violations as "Error: ..." or "Warning: ..." lines, prefixed by 
+// source if not empty, returns number of errors
+int PrintPinViolations(FILE *f, const std::vector<PinViolation> &violations, const std::string &source = "");
+
+#endif
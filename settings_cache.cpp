@@ -0,0 +1,128 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "settings_cache.h"
+#include "atomic_file.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// Entry file format, changed when layout of cached entries or compiled
+// output of settings changes
+#define CACHE_FORMAT	"2"
+
+// Build of tool, entries of other builds are never used, even if format
+// was not changed with parser
+#define CACHE_BUILD		__DATE__ " " __TIME__
+
+// 128 bit hash, two 64 bit lanes over 8 byte words (MurmurHash64 mixing)
+struct Hash128 {
+	uint64_t h[2] = {0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL};
+	
+	static uint64_t Mix(uint64_t k)
+	{
+		k ^= k >> 33;
+		k *= 0xff51afd7ed558ccdULL;
+		k ^= k >> 33;
+		k *= 0xc4ceb9fe1a85ec53ULL;
+		return k ^ (k >> 33);
+	}
+	void Word(uint64_t k)
+	{
+		h[0] = (h[0] ^ Mix(k)) * 0x100000001b3ULL;
+		h[1] = (h[1] ^ Mix(k + 0x9e3779b97f4a7c15ULL)) * 0xc6a4a7935bd1e995ULL;
+	}
+	void Add(const void *data, size_t size)
+	{
+		const uint8_t *p = (const uint8_t*)data;
+		uint64_t k;
+		for (; size >= 8; p += 8, size -= 8) {
+			memcpy(&k, p, 8);
+			Word(k);
+		}
+		k = 0;
+		memcpy(&k, p, size);
+		Word(k ^ ((uint64_t)size << 56));
+	}
+};
+
+SettingsCache::SettingsCache(const char *dir, const char *toolVersion) : 
+	dir(dir), toolVersion(toolVersion), hits(0), misses(0)
+{
+	mkdir(dir, 0755);
+}
+
+std::string SettingsCache::Key(const char *data, size_t size, const char *extra) const
+{
+	char key[64];
+	Hash128 hash;
+	hash.Add(CACHE_FORMAT, strlen(CACHE_FORMAT));
+	hash.Add(toolVersion.c_str(), toolVersion.size());
+	hash.Add(CACHE_BUILD, strlen(CACHE_BUILD));
+	hash.Add(extra, strlen(extra));
+	hash.Add(data, size);
+	uint64_t *h = hash.h;
+	snprintf(key, sizeof(key), "%016llx%016llx-%zu", (unsigned long long)h[0], (unsigned long long)h[1], size);
+	return key;
+}
+
+std::string SettingsCache::_Path(const std::string &key) const
+{
+	return dir + "/" + key + ".cec";
+}
+
+bool SettingsCache::Load(const std::string &key, void *entry, size_t size)
+{
+	std::lock_guard<std::mutex> guard(mutex);
+	auto i = entries.find(key);
+	bool hit = i != entries.end() && i->second.size() == size;
+	if (hit) {
+		memcpy(entry, i->second.data(), size);
+	} else {
+		// Entry file must have exactly size bytes, one more is read to check
+		int fd = open(_Path(key).c_str(), O_RDONLY);
+		if (fd >= 0) {
+			std::string data(size + 1, '\0');
+			hit = read(fd, &data[0], size + 1) == (ssize_t)size;
+			close(fd);
+			if (hit) {
+				data.resize(size);
+				memcpy(entry, data.data(), size);
+				entries[key] = std::move(data);
+			}
+		}
+	}
+	if (hit) hits++;
+	else misses++;
+	return hit;
+}
+
+int SettingsCache::Store(const std::string &key, const void *entry, size_t size)
+{
+	// Lost entry is only parsed again, so it need not be durable
+	AtomicFile file(_Path(key).c_str(), false);
+	if (file.File()) fwrite(entry, 1, size, file.File());
+	if (file.Commit() < 0) return -1;
+	std::lock_guard<std::mutex> guard(mutex);
+	entries[key] = std::string((const char*)entry, size);
+	return 0;
+}
@@ -0,0 +1,59 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SETTINGS_CACHE_H
+#define SETTINGS_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+// Cache of compiled settings in directory, one file per entry. Entries 
+// are keyed by hash of settings file contents, tool version and build of
+// tool, so any change of settings or tool makes new entry. Entries loaded
+// or stored are also kept in memory, so repeated loads of same settings
+// in one process (variants, server, batches) do not read entry file.
+class SettingsCache
+{
+public:
+	SettingsCache(const char *dir, const char *toolVersion);
+	// Key of settings data, extra is added to key (i.e. variant name)
+	std::string Key(const char *data, size_t size, const char *extra = "") const;
+	// Loads entry of exactly size bytes, returns false on miss
+	bool Load(const std::string &key, void *entry, size_t size);
+	// Stores entry, atomically replacing old one
+	int Store(const std::string &key, const void *entry, size_t size);
+	unsigned long Hits() const { return hits; }
+	unsigned long Misses() const { return misses; }
+private:
+	std::string _Path(const std::string &key) const;
+	
+	std::string dir;
+	std::string toolVersion;
+	std::mutex mutex;
+	std::unordered_map<std::string, std::string> entries;
+	std::atomic<unsigned long> hits;
+	std::atomic<unsigned long> misses;
+};
+
+#endif
@@ -0,0 +1,121 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "settings_parser.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <ctype.h>
+
+SettingsFile::SettingsFile(const char *fname) : open(false)
+{
+	FILE *f = fopen(fname, "rb");
+	if (!f) return;
+	
+	char buffer[16384];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) data.append(buffer, n);
+	open = !ferror(f);
+	fclose(f);
+}
+
+SettingsTokenizer::SettingsTokenizer(const char *data, size_t size, bool quiet) :
+	p(data), end(data + size), lineStart(data), line(0), quiet(quiet), errors(0)
+{
+}
+
+static inline bool IsBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+bool SettingsTokenizer::Next(SettingsLine &l)
+{
+	while (p < end) {
+		lineStart = p;
+		line++;
+		l.line = line;
+		l.argCount = 0;
+		l.keyword = std::string_view();
+		
+		bool valid = true;
+		while (p < end && *p != '\n') {
+			while (p < end && IsBlank(*p)) p++;
+			if (p == end || *p == '\n') break;
+			
+			if (*p == '#') {
+				// Comment till end of line
+				while (p < end && *p != '\n') p++;
+				break;
+			}
+			
+			const char *start = p;
+			std::string_view token;
+			if (*p == '"') {
+				start = ++p;
+				while (p < end && *p != '"' && *p != '\n') p++;
+				token = std::string_view(start, p - start);
+				if (p < end && *p == '"') p++;
+				else if (valid) {
+					Error(start - 1, "missing closing quote");
+					valid = false;
+				}
+			} else {
+				while (p < end && !IsBlank(*p) && *p != '\n' && *p != '#' && *p != '"') p++;
+				token = std::string_view(start, p - start);
+			}
+			
+			if (!valid) continue;
+			if (l.keyword.empty()) {
+				if (!isalnum((unsigned char)*start)) {
+					Error(start, "can't parse line");
+					valid = false;
+				}
+				l.keyword = token;
+			} else if (l.argCount < SETTINGS_MAX_ARGS) {
+				l.args[l.argCount++] = token;
+			} else {
+				Error(start, "too many values");
+				valid = false;
+			}
+		}
+		
+		const char *lineEnd = p;
+		if (lineEnd > lineStart && lineEnd[-1] == '\r') lineEnd--;
+		l.text = std::string_view(lineStart, lineEnd - lineStart);
+		if (p < end) p++;
+		
+		if (valid && !l.keyword.empty()) return true;
+	}
+	return false;
+}
+
+void SettingsTokenizer::Error(const char *pos, const char *format, ...) const
+{
+	va_list args;
+	
+	errors++;
+	if (quiet) return;
+	// Printed with one call, so messages of concurrent loads do not mix
+	char message[256];
+	va_start(args, format);
+	vsnprintf(message, sizeof(message), format, args);
+	va_end(args);
+	printf("Error at line %u, column %u: %s\n", line, (unsigned int)(pos - lineStart) + 1, message);
+}
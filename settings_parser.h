@@ -0,0 +1,76 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SETTINGS_PARSER_H
+#define SETTINGS_PARSER_H
+
+#include <stddef.h>
+#include <string>
+#include <string_view>
+
+#define SETTINGS_MAX_ARGS	8
+
+// Keyword and values of one settings line. Spans point into tokenized
+// buffer, quoted values are without quotes.
+struct SettingsLine {
+	unsigned int line;
+	std::string_view text;
+	std::string_view keyword;
+	std::string_view args[SETTINGS_MAX_ARGS];
+	unsigned int argCount;
+};
+
+// Settings file read into memory at once
+class SettingsFile
+{
+public:
+	SettingsFile(const char *fname);
+	bool IsOpen() const { return open; }
+	const char *Data() const { return data.data(); }
+	size_t Size() const { return data.size(); }
+private:
+	std::string data;
+	bool open;
+};
+
+// Single pass tokenizer of settings text. Splits each line into keyword 
+// and values in place, comments starting with # and empty lines are
+// skipped. There is no line length limit.
+class SettingsTokenizer
+{
+public:
+	// Quiet tokenizer only counts errors
+	SettingsTokenizer(const char *data, size_t size, bool quiet = false);
+	// Gets next line with keyword, returns false at end of data
+	bool Next(SettingsLine &line);
+	// Prints error with line and column of position in current line
+	void Error(const char *p, const char *format, ...) const 
+		__attribute__((format(printf, 3, 4)));
+	int ErrorCount() const { return errors; }
+private:
+	const char *p;
+	const char *end;
+	const char *lineStart;
+	unsigned int line;
+	bool quiet;
+	mutable int errors;
+};
+
+#endif
@@ -0,0 +1,165 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "station.h"
+#include "bounded_queue.h"
+#include "board_number_allocator.h"
+#include "pin_validator.h"
+#include <string.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <thread>
+
+// Image prepared ahead of programming
+struct PreparedImage {
+	int boardNumber;
+	char serial[CAPE_SERIAL_LEN + 1];
+	uint8_t image[CAPE_SEALED_SIZE];
+	size_t size;
+	int errors;					// pin rule errors
+};
+
+struct StationResult {
+	int boardNumber;
+	char serial[CAPE_SERIAL_LEN + 1];
+	int ret;
+	ProgramResult r;
+	double waitMs;				// time programming waited for image
+	double programMs;
+};
+
+static double Ms(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Board number of next board, -1 when there are no more
+static int NextBoardNumber(const CapeEeprom &cape, const StationOptions &options, unsigned int i)
+{
+	std::string_view serial = cape.GetSerialNumber();
+	int first = atoi(std::string(cape.GetBoardNumber()).c_str());
+	if (i == 0) return first;
+	if (!options.allocator) return first + i > BOARD_NUMBER_MAX ? -1 : first + i;
+	
+	// Serial number is WWYYAAAANNNN, assembly code shorter than 4 characters
+	// is padded with leading spaces
+	std::string asmCode(serial.substr(4, 4));
+	asmCode.erase(0, asmCode.find_first_not_of(' '));
+	return options.allocator->Allocate(asmCode.c_str(), atoi(std::string(serial.substr(0, 2)).c_str()), 
+		atoi(std::string(serial.substr(2, 2)).c_str()));
+}
+
+static void Prepare(const CapeEeprom &cape, const StationOptions &options, 
+	BoundedQueue<PreparedImage> &images)
+{
+	for (unsigned int i = 0; options.count == 0 || i < options.count; i++) {
+		PreparedImage p;
+		p.boardNumber = NextBoardNumber(cape, options, i);
+		if (p.boardNumber < 0) {
+			fprintf(stderr, "No more board numbers after %u boards\n", i);
+			break;
+		}
+		CapeEeprom c(cape);
+		c.SetBoardNumber(p.boardNumber);
+		p.size = options.sealed ? c.EncodeSealed(p.image, sizeof(p.image)) : c.Encode(p.image, sizeof(p.image));
+		memcpy(p.serial, p.image + CAPE_SERIAL_OFS, CAPE_SERIAL_LEN);
+		p.serial[CAPE_SERIAL_LEN] = '\0';
+		p.errors = ValidateCapeImage(p.image);
+		if (!images.Push(p)) break;
+	}
+	images.Close();
+}
+
+static void Report(const StationOptions &options, BoundedQueue<StationResult> &results, int &passed, int &failed)
+{
+	StationResult s;
+	printf("%-6s %-12s  %-7s %9s %9s  %s\n", "BOARD", "SERIAL", "PAGES", "WAIT ms", "PROG ms", "RESULT");
+	fflush(stdout);
+	while (results.Pop(s)) {
+		printf("%04d   %-12s  %2d/%-2d   %9.3f %9.3f  %s\n", s.boardNumber, s.serial, s.r.pagesWritten, 
+			s.r.pagesTotal, s.waitMs, s.programMs, s.ret == 0 ? "PASS" : "FAIL");
+		fflush(stdout);
+		if (s.ret == 0) passed++;
+		else failed++;
+		if (s.ret == 0 && options.serials) options.serials->push_back(s.serial);
+	}
+}
+
+int RunStation(const CapeEeprom &cape, const StationOptions &options)
+{
+	// Pin rules do not depend on board number, template which breaks them
+	// would fail every board
+	uint8_t image[CAPE_EEPROM_SIZE];
+	std::vector<PinViolation> violations;
+	cape.Encode(image, sizeof(image));
+	if (ValidateCapeImage(image, &violations)) {
+		PrintPinViolations(stderr, violations, "template");
+		fprintf(stderr, "Settings break pin rules, station not started\n");
+		return -1;
+	}
+	
+	// One image is prepared while other is programmed
+	BoundedQueue<PreparedImage> images(1);
+	BoundedQueue<StationResult> results(STATION_RESULT_QUEUE);
+	int passed = 0, failed = 0;
+	
+	std::thread generator(Prepare, std::cref(cape), std::cref(options), std::ref(images));
+	std::thread reporter(Report, std::cref(options), std::ref(results), std::ref(passed), std::ref(failed));
+	
+	char line[64];
+	PreparedImage p;
+	for (;;) {
+		// Image is taken before operator is asked for board, so no board is
+		// seated after count boards or last board number
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (!images.Pop(p)) break;
+		StationResult s;
+		s.waitMs = Ms(start);
+		if (options.trigger) {
+			fprintf(stderr, "Seat board and press Enter (q to stop): ");
+			if (!fgets(line, sizeof(line), options.trigger) || line[0] == 'q') break;
+		}
+		
+		s.boardNumber = p.boardNumber;
+		memcpy(s.serial, p.serial, sizeof(s.serial));
+		start = std::chrono::steady_clock::now();
+		if (p.errors) {
+			// Images violating pin rules are never programmed
+			std::vector<PinViolation> violations;
+			ValidateCapeImage(p.image, &violations);
+			PrintPinViolations(stderr, violations, options.device);
+			s.r = ProgramResult();
+			s.ret = -1;
+		} else {
+			s.ret = ProgramEeprom(options.device, p.image, p.size, options.pageSize, &s.r, options.stats);
+		}
+		s.programMs = Ms(start);
+		results.Push(s);
+	}
+	
+	// Image prepared for board which was not programmed is dropped
+	images.Close();
+	generator.join();
+	results.Close();
+	reporter.join();
+	printf("%d boards, %d passed, %d failed\n", passed + failed, passed, failed);
+	return failed;
+}
@@ -0,0 +1,58 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STATION_H
+#define STATION_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "cape_eeprom.h"
+#include "eeprom_programmer.h"
+
+class BoardNumberAllocator;
+class CapeStats;
+
+#define STATION_RESULT_QUEUE	64
+
+struct StationOptions {
+	const char *device = NULL;				// EEPROM programmed for each board
+	unsigned int pageSize = EEPROM_PAGE_SIZE;
+	unsigned int count = 0;					// boards to program, 0 until stopped
+	BoardNumberAllocator *allocator = NULL;	// board numbers after first one
+	bool sealed = false;					// images with integrity trailer
+	FILE *trigger = NULL;					// one line per seated board, NULL to not wait
+	CapeStats *stats = NULL;
+	std::vector<std::string> *serials = NULL;	// serial numbers of passed boards, if not NULL
+};
+
+// Programs one board after another on single EEPROM device. Image of next
+// board (board number, encode, pin rule validation) is prepared on
+// background thread while current board is programmed and verified, and
+// results are printed by reporter thread from bounded queue. First board
+// has board number of cape, following boards next board numbers, or board
+// numbers from allocator. With allocator, board number of cape must be
+// allocated from it too, as allocator does not know any other board
+// number. Before each board a line is read from trigger,
+// station stops at end of file or line "q", or after count boards. Returns
+// number of failed boards, -1 if settings break pin rules.
+int RunStation(const CapeEeprom &cape, const StationOptions &options);
+
+#endif
@@ -0,0 +1,43 @@
+/* 
+Cape_eeprom: BeagleBone Cape EEPROM Generator
+Copyright (c) 2017 Milan Neskovic
+
+This file is part of Cape_eeprom
+
+Cape_eeprom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Cape_eeprom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Cape_eeprom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "worker_pool.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+void RunParallel(size_t count, unsigned int threads, const std::function<void(size_t)> &job)
+{
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> workers;
+	
+	if (threads == 0) threads = std::thread::hardware_concurrency();
+	if (threads == 0) threads = 1;
+	if (threads > count) threads = count;
+	
+	auto worker = [&]() {
+		for (size_t i = next++; i < count; i = next++) job(i);
+	};
+	
+	// Calling thread is one of workers
+	for (unsigned int t = 1; t < threads; t++) workers.push_back(std::thread(worker));
+	if (threads) worker();
+	for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+}